@@ -1,6 +1,7 @@
 #pragma once
 #include <cassert>
 #include "Math.h"
+#include "FastMath.h"
 
 namespace dae
 {
@@ -38,7 +39,7 @@ namespace dae
 		{
 			const auto reflect = l - (2.f * (Vector3::Dot(n, l) * n));
 			const float cosAlpha = std::max(Vector3::Dot(reflect, -v),0.f);
-			const float specularPow{ ks * powf(cosAlpha,exp) };
+			const float specularPow{ ks * FastMath::Pow(cosAlpha,exp) };
 			ColorRGB specular{ specularPow ,specularPow,specularPow };
 			//todo: W3
 			//assert(false && "Not Implemented Yet");
@@ -56,7 +57,7 @@ namespace dae
 		{
 			ColorRGB One{1.f,1.f,1.f};
 			//ColorRGB f0Complement{ 1.f - f0.r,1.f - f0.g,1.f - f0.b };
-			return f0 + (One - f0) * powf((1.f - Vector3::Dot(h,v)),5);
+			return f0 + (One - f0) * FastMath::Schlick(Vector3::Dot(h,v));
 		}
 
 		/**
@@ -111,5 +112,74 @@ namespace dae
 			return  maskingGeo * shadowingGeo;
 		}
 
+		/**
+		 * \brief BRDF Cook-Torrance specular term >> GGX distribution, Schlick Fresnel and Smith geometry
+		 * \param n Normalized surface normal
+		 * \param v Normalized direction towards the viewer
+		 * \param l Normalized direction towards the light
+		 * \param f0 Base reflectivity
+		 * \param roughness Roughness of the material, above 0
+		 * \param fresnel Receives the Fresnel term (f0 when nothing is reflected), the diffuse part only gets the rest
+		 * \return Cook-Torrance specular reflectance, black when the light or the viewer is below the surface
+		 */
+		static ColorRGB CookTorrance(const Vector3& n, const Vector3& v, const Vector3& l, const ColorRGB& f0, float roughness, ColorRGB& fresnel)
+		{
+			const float nDotL{ Vector3::Dot(n,l) };
+			const float nDotV{ Vector3::Dot(n,v) };
+			fresnel = f0;
+			if (nDotL <= 0.f || nDotV <= 0.f)
+				return {};
+
+			const Vector3 h{ FastMath::Normalize(v + l) };
+			fresnel = FresnelFunction_Schlick(h, v, f0);
+			const float distribution{ NormalDistribution_GGX(n, h, roughness) };
+			const float geometry{ GeometryFunction_Smith(n, v, l, roughness) };
+			return fresnel * (distribution * geometry / (4.f * nDotL * nDotV));
+		}
+
+		/**
+		 * \brief CookTorrance above for SimdFloat::Width pixels at once, with a grey f0
+		 * \param n, v, l x, y and z lanes of the normalized normal, view and light directions
+		 * \return The same reflectance as the scalar version, up to rounding
+		 */
+		template<typename SimdFloat, typename Float = typename SimdFloat::Float>
+		Float CookTorrance(const Float(&n)[3], const Float(&v)[3], const Float(&l)[3], Float f0, Float roughness, Float& fresnel)
+		{
+			const auto dot = [](const Float(&a)[3], const Float(&b)[3])
+				{
+					return SimdFloat::Add(SimdFloat::Add(SimdFloat::Mul(a[0], b[0]), SimdFloat::Mul(a[1], b[1])), SimdFloat::Mul(a[2], b[2]));
+				};
+			const Float zero{ SimdFloat::Zero() };
+			const Float one{ SimdFloat::Set1(1.f) };
+
+			const Float nDotL{ dot(n, l) };
+			const Float nDotV{ dot(n, v) };
+			const Float isReflected{ SimdFloat::And(SimdFloat::CmpGt(nDotL, zero), SimdFloat::CmpGt(nDotV, zero)) };
+
+			//Can be NaN for lanes that aren't reflected, the selects below drop those
+			Float h[3]{ SimdFloat::Add(v[0], l[0]), SimdFloat::Add(v[1], l[1]), SimdFloat::Add(v[2], l[2]) };
+			const Float invLength{ SimdFloat::Rsqrt(dot(h, h)) };
+			for (Float& component : h)
+				component = SimdFloat::Mul(component, invLength);
+
+			const Float x{ SimdFloat::Sub(one, dot(h, v)) };
+			const Float x2{ SimdFloat::Mul(x, x) };
+			fresnel = SimdFloat::Select(isReflected, SimdFloat::Add(f0, SimdFloat::Mul(SimdFloat::Sub(one, f0), SimdFloat::Mul(SimdFloat::Mul(x2, x2), x))), f0);
+
+			const Float a{ SimdFloat::Mul(roughness, roughness) };
+			const Float aSquared{ SimdFloat::Mul(a, a) };
+			const Float nDotH{ dot(n, h) };
+			const Float denominator{ SimdFloat::Add(SimdFloat::Mul(SimdFloat::Mul(nDotH, nDotH), SimdFloat::Sub(aSquared, one)), one) };
+			const Float distribution{ SimdFloat::Div(aSquared, SimdFloat::Mul(SimdFloat::Set1(PI), SimdFloat::Mul(denominator, denominator))) };
+
+			const Float aPlusOne{ SimdFloat::Add(a, one) };
+			const Float k{ SimdFloat::Mul(SimdFloat::Mul(aPlusOne, aPlusOne), SimdFloat::Set1(1.f / 8.f)) };
+			const auto schlickGGX = [&](Float nDotX) { return SimdFloat::Div(nDotX, SimdFloat::Add(SimdFloat::Mul(nDotX, SimdFloat::Sub(one, k)), k)); };
+			const Float geometry{ SimdFloat::Mul(schlickGGX(nDotV), schlickGGX(nDotL)) };
+
+			const Float specular{ SimdFloat::Div(SimdFloat::Mul(fresnel, SimdFloat::Mul(distribution, geometry)),
+				SimdFloat::Mul(SimdFloat::Set1(4.f), SimdFloat::Mul(nDotL, nDotV))) };
+			return SimdFloat::And(isReflected, specular);
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,678 @@
+#include "pch.h"
+#include "Benchmarks.h"
+#include "Texture.h"
+#include "FastMath.h"
+#include "BRDF.h"
+#include "Simd.h"
+#include "SplitSumLut.h"
+#include "Light.h"
+#include <chrono>
+#include <iomanip>
+#include <random>
+
+namespace dae
+{
+	namespace Benchmarks
+	{
+		namespace
+		{
+			//Set-associative cache with LRU replacement that only keeps track of tags, good enough to compare access patterns
+			class CacheSimulator final
+			{
+			public:
+				CacheSimulator(size_t sizeInBytes, size_t lineSize, size_t numWays) :
+					m_LineSize{ lineSize },
+					m_NumWays{ numWays },
+					m_NumSets{ sizeInBytes / (lineSize * numWays) },
+					m_Tags(m_NumSets * numWays, SIZE_MAX),
+					m_LastUse(m_NumSets * numWays)
+				{
+				}
+
+				void Access(size_t address)
+				{
+					const size_t line{ address / m_LineSize };
+					const size_t firstWay{ (line % m_NumSets) * m_NumWays };
+					++m_NumAccesses;
+
+					size_t leastRecentWay{ firstWay };
+					for (size_t way{ firstWay }; way < firstWay + m_NumWays; ++way)
+					{
+						if (m_Tags[way] == line)
+						{
+							m_LastUse[way] = m_NumAccesses;
+							return;
+						}
+						if (m_LastUse[way] < m_LastUse[leastRecentWay])
+							leastRecentWay = way;
+					}
+
+					++m_NumMisses;
+					m_Tags[leastRecentWay] = line;
+					m_LastUse[leastRecentWay] = m_NumAccesses;
+				}
+
+				float GetMissRate() const { return m_NumAccesses > 0 ? float(m_NumMisses) / float(m_NumAccesses) : 0.f; }
+
+			private:
+				size_t m_LineSize{};
+				size_t m_NumWays{};
+				size_t m_NumSets{};
+				std::vector<size_t> m_Tags{};
+				std::vector<uint64_t> m_LastUse{};
+				uint64_t m_NumAccesses{};
+				uint64_t m_NumMisses{};
+			};
+
+			//A screen-sized grid of pixels laid over the middle of the texture, rotated and scaled like a surface of the vehicle
+			struct SamplePattern
+			{
+				const char* pName{};
+				float angleDegrees{};
+				float texelsPerPixel{};
+			};
+			constexpr int PatternSize{ 256 };
+			constexpr SamplePattern SamplePatterns[]
+			{
+				{ "aligned", 0.f, 1.f },
+				{ "rotated 30", 30.f, 1.f },
+				{ "rotated 90", 90.f, 1.f },
+				{ "rotated 45, 2x minified", 45.f, 2.f }
+			};
+
+			Vector2 GetPatternUV(const SamplePattern& pattern, const Texture& texture, int px, int py)
+			{
+				const float angle{ pattern.angleDegrees * TO_RADIANS };
+				const float offsetX{ (px - PatternSize / 2) * pattern.texelsPerPixel };
+				const float offsetY{ (py - PatternSize / 2) * pattern.texelsPerPixel };
+				return
+				{
+					0.5f + (offsetX * std::cos(angle) - offsetY * std::sin(angle)) / float(texture.GetWidth()),
+					0.5f + (offsetX * std::sin(angle) + offsetY * std::cos(angle)) / float(texture.GetHeight())
+				};
+			}
+
+			//Replays the bilinear footprints of the full resolution level through a simulated L1 and L2
+			void SimulateCacheMisses(const Texture& texture, const SamplePattern& pattern, float& l1MissRate, float& l2MissRate)
+			{
+				CacheSimulator l1{ 32 * 1024, 64, 8 };
+				CacheSimulator l2{ 512 * 1024, 64, 16 };
+
+				const int width{ texture.GetWidth() };
+				const int height{ texture.GetHeight() };
+				for (int py{}; py < PatternSize; ++py)
+				{
+					for (int px{}; px < PatternSize; ++px)
+					{
+						const Vector2 uv{ GetPatternUV(pattern, texture, px, py) };
+						//Same footprint as LinearWrapSampler
+						const int x0{ FloorToTexel(uv.x * width - 0.5f) };
+						const int y0{ FloorToTexel(uv.y * height - 0.5f) };
+						const int xs[2]{ AddressTexel<TextureAddressMode::Wrap>(x0, width), AddressTexel<TextureAddressMode::Wrap>(x0 + 1, width) };
+						const int ys[2]{ AddressTexel<TextureAddressMode::Wrap>(y0, height), AddressTexel<TextureAddressMode::Wrap>(y0 + 1, height) };
+						for (int y : ys)
+						{
+							for (int x : xs)
+							{
+								const size_t address{ texture.GetTexelIndex(0, x, y) * sizeof(uint32_t) };
+								l1.Access(address);
+								l2.Access(address);
+							}
+						}
+					}
+				}
+
+				l1MissRate = l1.GetMissRate();
+				l2MissRate = l2.GetMissRate();
+			}
+
+			//Millions of bilinear Sample calls per second on one thread
+			float MeasureSampleThroughput(const Texture& texture, const SamplePattern& pattern)
+			{
+				//The uvs are set up front so only the sampling itself is timed
+				std::vector<Vector2> uvs{};
+				uvs.reserve(PatternSize * PatternSize);
+				for (int py{}; py < PatternSize; ++py)
+				{
+					for (int px{}; px < PatternSize; ++px)
+					{
+						uvs.emplace_back(GetPatternUV(pattern, texture, px, py));
+					}
+				}
+
+				constexpr int numRepeats{ 20 };
+				const LinearWrapSampler sampler{};
+				float checksum{};
+
+				const auto start{ std::chrono::high_resolution_clock::now() };
+				for (int repeat{}; repeat < numRepeats; ++repeat)
+				{
+					for (const Vector2& uv : uvs)
+					{
+						checksum += texture.Sample(sampler, uv).r;
+					}
+				}
+				const auto end{ std::chrono::high_resolution_clock::now() };
+
+				//Keeps the loop from being optimized away
+				volatile float sink{ checksum };
+				(void)sink;
+
+				const float seconds{ std::chrono::duration<float>(end - start).count() };
+				return float(numRepeats) * float(uvs.size()) / seconds / 1'000'000.f;
+			}
+
+			void RunTextureLayoutBenchmark()
+			{
+				std::cout << "Texture layout: linear vs 4x4 Z-order swizzled, bilinear on mip 0, " << PatternSize << "x" << PatternSize << " pixels per pattern\n";
+				std::cout << "Simulated caches: L1 32 KB 8-way, L2 512 KB 16-way, 64 byte lines\n\n";
+
+				const char* texturePaths[]
+				{
+					"Resources/vehicle_diffuse.png",
+					"Resources/vehicle_normal.png",
+					"Resources/vehicle_specular.png",
+					"Resources/vehicle_gloss.png"
+				};
+				const Texture::Layout layouts[]{ Texture::Layout::Linear, Texture::Layout::Swizzled };
+
+				std::cout << std::fixed << std::setprecision(2);
+				for (const char* pPath : texturePaths)
+				{
+					std::cout << pPath << "\n";
+					for (Texture::Layout layout : layouts)
+					{
+						Texture* pTexture{ Texture::LoadFromFile(nullptr, pPath, layout) };
+						if (!pTexture)
+						{
+							std::cout << "  failed to load\n";
+							break;
+						}
+
+						for (const SamplePattern& pattern : SamplePatterns)
+						{
+							float l1MissRate{};
+							float l2MissRate{};
+							SimulateCacheMisses(*pTexture, pattern, l1MissRate, l2MissRate);
+							const float throughput{ MeasureSampleThroughput(*pTexture, pattern) };
+
+							std::cout << "  " << std::left << std::setw(9) << (layout == Texture::Layout::Linear ? "linear" : "swizzled")
+								<< std::setw(26) << pattern.pName << std::right
+								<< "L1 miss " << std::setw(6) << l1MissRate * 100.f << "%  "
+								<< "L2 miss " << std::setw(6) << l2MissRate * 100.f << "%  "
+								<< std::setw(7) << throughput << " Msamples/s\n";
+						}
+						delete pTexture;
+					}
+				}
+				std::cout << "\n";
+			}
+
+			//Nanoseconds per SampleGrad for a footprint stretched anisotropy times along u, on a grid of uvs over the whole texture
+			template<typename Sampler>
+			float MeasureSampleGradCost(const Texture& texture, const Sampler& sampler, float anisotropy)
+			{
+				const Vector2 uvDx{ anisotropy / float(texture.GetWidth()), 0.f };
+				const Vector2 uvDy{ 0.f, 1.f / float(texture.GetHeight()) };
+
+				std::vector<Vector2> uvs{};
+				uvs.reserve(PatternSize * PatternSize);
+				for (int py{}; py < PatternSize; ++py)
+				{
+					for (int px{}; px < PatternSize; ++px)
+					{
+						uvs.emplace_back((px + 0.5f) / PatternSize, (py + 0.5f) / PatternSize);
+					}
+				}
+
+				constexpr int numRepeats{ 5 };
+				float checksum{};
+
+				const auto start{ std::chrono::high_resolution_clock::now() };
+				for (int repeat{}; repeat < numRepeats; ++repeat)
+				{
+					for (const Vector2& uv : uvs)
+					{
+						checksum += texture.SampleGrad(sampler, uv, uvDx, uvDy).r;
+					}
+				}
+				const auto end{ std::chrono::high_resolution_clock::now() };
+
+				//Keeps the loop from being optimized away
+				volatile float sink{ checksum };
+				(void)sink;
+
+				const float nanoseconds{ std::chrono::duration<float, std::nano>(end - start).count() };
+				return nanoseconds / (float(numRepeats) * float(uvs.size()));
+			}
+
+			void RunAnisotropicFilteringBenchmark()
+			{
+				std::cout << "Anisotropic filtering: cost per SampleGrad, footprint 1 texel along v and stretched along u\n\n";
+
+				Texture* pTexture{ Texture::LoadFromFile(nullptr, "Resources/vehicle_diffuse.png") };
+				if (!pTexture)
+				{
+					std::cout << "  failed to load\n\n";
+					return;
+				}
+
+				const LinearWrapSampler trilinear{};
+				AnisotropicWrapSampler anisotropic4{};
+				anisotropic4.maxAnisotropy = 4;
+				const AnisotropicWrapSampler anisotropic16{};
+
+				std::cout << "  " << std::setw(10) << "stretch" << std::setw(14) << "trilinear" << std::setw(22) << "aniso max 4" << std::setw(22) << "aniso max 16" << "\n";
+				const float stretches[]{ 1.f, 2.f, 4.f, 8.f, 16.f };
+				for (float stretch : stretches)
+				{
+					const auto getNumProbes = [pTexture, stretch](int maxAnisotropy)
+						{
+							float lod{};
+							Vector2 probeStep{};
+							return Texture::CalculateAnisotropy({ stretch / float(pTexture->GetWidth()), 0.f }, { 0.f, 1.f / float(pTexture->GetHeight()) },
+								pTexture->GetWidth(), pTexture->GetHeight(), pTexture->GetNumMipLevels(), maxAnisotropy, lod, probeStep);
+						};
+
+					std::cout << "  " << std::setw(9) << stretch << "x"
+						<< std::setw(11) << MeasureSampleGradCost(*pTexture, trilinear, stretch) << " ns"
+						<< std::setw(11) << MeasureSampleGradCost(*pTexture, anisotropic4, stretch) << " ns, " << std::setw(2) << getNumProbes(4) << " probes"
+						<< std::setw(11) << MeasureSampleGradCost(*pTexture, anisotropic16, stretch) << " ns, " << std::setw(2) << getNumProbes(16) << " probes\n";
+				}
+				std::cout << "\n";
+
+				delete pTexture;
+			}
+
+			//Arguments for a one or two argument function, the one argument functions ignore y
+			struct MathInputs
+			{
+				std::vector<float> x{};
+				std::vector<float> y{};
+
+				void Add(float xValue, float yValue = 0.f)
+				{
+					x.emplace_back(xValue);
+					y.emplace_back(yValue);
+				}
+			};
+
+			//Largest error against the exact function evaluated in double, relative errors skip exact results up to minExact
+			template<typename Approximation, typename Exact>
+			double MeasureMaxError(const MathInputs& inputs, const Approximation& approximation, const Exact& exact, bool isRelative, double minExact)
+			{
+				double maxError{};
+				for (size_t i{}; i < inputs.x.size(); ++i)
+				{
+					const double expected{ exact(double(inputs.x[i]), double(inputs.y[i])) };
+					const double error{ std::abs(double(approximation(inputs.x[i], inputs.y[i])) - expected) };
+					if (!isRelative)
+						maxError = std::max(maxError, error);
+					else if (std::abs(expected) > minExact)
+						maxError = std::max(maxError, error / std::abs(expected));
+				}
+				return maxError;
+			}
+
+			//Nanoseconds per call on one thread
+			template<typename Function>
+			float MeasureMathCost(const MathInputs& inputs, const Function& function)
+			{
+				constexpr int numRepeats{ 20 };
+				float checksum{};
+
+				const auto start{ std::chrono::high_resolution_clock::now() };
+				for (int repeat{}; repeat < numRepeats; ++repeat)
+				{
+					for (size_t i{}; i < inputs.x.size(); ++i)
+					{
+						checksum += function(inputs.x[i], inputs.y[i]);
+					}
+				}
+				const auto end{ std::chrono::high_resolution_clock::now() };
+
+				//Keeps the loop from being optimized away
+				volatile float sink{ checksum };
+				(void)sink;
+
+				const float nanoseconds{ std::chrono::duration<float, std::nano>(end - start).count() };
+				return nanoseconds / (float(numRepeats) * float(inputs.x.size()));
+			}
+
+			//Prints one row and returns whether the error stays within the bound FastMath promises
+			template<typename Approximation, typename Library, typename Exact>
+			bool CheckMathFunction(const char* pName, const MathInputs& inputs, const Approximation& approximation, const Library& library, const Exact& exact,
+				bool isRelative, float bound, double minExact = 0.0)
+			{
+				const double maxError{ MeasureMaxError(inputs, approximation, exact, isRelative, minExact) };
+				const bool isWithinBound{ maxError <= bound };
+
+				std::cout << "  " << std::left << std::setw(11) << pName << std::right
+					<< std::scientific << std::setprecision(2) << std::setw(10) << maxError << (isRelative ? " rel" : " abs")
+					<< std::setw(10) << bound
+					<< std::fixed << std::setw(9) << MeasureMathCost(inputs, approximation) << " ns"
+					<< std::setw(9) << MeasureMathCost(inputs, library) << " ns"
+					<< (isWithinBound ? "" : "  EXCEEDED") << "\n";
+				return isWithinBound;
+			}
+
+			bool RunFastMathBenchmark()
+			{
+				std::cout << "Fast math: worst error against the exact function, cost per call against the C runtime\n\n";
+				std::cout << "  " << std::left << std::setw(11) << "function" << std::right << std::setw(14) << "max error" << std::setw(10) << "bound"
+					<< std::setw(12) << "fast" << std::setw(12) << "libm" << "\n";
+
+				//Log-spaced over most of the float range
+				constexpr int numInputs{ 1 << 20 };
+				MathInputs positive{};
+				for (int i{}; i < numInputs; ++i)
+					positive.Add(std::pow(10.f, -30.f + 60.f * float(i) / numInputs));
+
+				MathInputs exponents{};
+				for (int i{}; i < numInputs; ++i)
+					exponents.Add(-125.f + 252.f * float(i) / numInputs);
+
+				//Phong's range: cosines in [0, 1] and exponents up to 128
+				MathInputs powers{};
+				for (int i{}; i < 1024; ++i)
+				{
+					for (int j{}; j < 1024; ++j)
+						powers.Add(float(i) / 1023.f, 128.f * float(j) / 1023.f);
+				}
+
+				//The relative check skips results up to 1e-30, x = 0 among them, so those get an absolute one
+				MathInputs tinyPowers{};
+				for (size_t i{}; i < powers.x.size(); ++i)
+				{
+					if (std::pow(double(powers.x[i]), double(powers.y[i])) <= 1e-30)
+						tinyPowers.Add(powers.x[i], powers.y[i]);
+				}
+
+				MathInputs cosines{};
+				MathInputs directions{};
+				for (int i{}; i < numInputs; ++i)
+				{
+					cosines.Add(float(i) / (numInputs - 1));
+					directions.Add(std::cos(float(i) * 0.001f), std::sin(float(i) * 0.0013f) * float(i % 97 + 1));
+				}
+
+				bool isAccurate{ true };
+				isAccurate &= CheckMathFunction("rsqrt", positive,
+					[](float x, float) { return FastMath::Rsqrt(x); },
+					[](float x, float) { return 1.f / std::sqrt(x); },
+					[](double x, double) { return 1.0 / std::sqrt(x); }, true, FastMath::RsqrtMaxRelativeError);
+				//The length of the result, which should be 1
+				isAccurate &= CheckMathFunction("normalize", directions,
+					[](float x, float y) { const Vector3 v{ FastMath::Normalize({ x, y, 0.5f }) }; return v.x * v.x + v.y * v.y + v.z * v.z; },
+					[](float x, float y) { const Vector3 v{ Vector3{ x, y, 0.5f }.Normalized() }; return v.x * v.x + v.y * v.y + v.z * v.z; },
+					[](double, double) { return 1.0; }, true, 2.f * FastMath::RsqrtMaxRelativeError);
+				isAccurate &= CheckMathFunction("log2", positive,
+					[](float x, float) { return FastMath::Log2(x); },
+					[](float x, float) { return std::log2(x); },
+					[](double x, double) { return std::log2(x); }, false, FastMath::Log2MaxAbsoluteError);
+				isAccurate &= CheckMathFunction("exp2", exponents,
+					[](float x, float) { return FastMath::Exp2(x); },
+					[](float x, float) { return std::exp2(x); },
+					[](double x, double) { return std::exp2(x); }, true, FastMath::Exp2MaxRelativeError);
+				isAccurate &= CheckMathFunction("pow", powers,
+					[](float x, float y) { return FastMath::Pow(x, y); },
+					[](float x, float y) { return std::pow(x, y); },
+					[](double x, double y) { return std::pow(x, y); }, true, FastMath::PowMaxRelativeError, 1e-30);
+				isAccurate &= CheckMathFunction("pow tiny", tinyPowers,
+					[](float x, float y) { return FastMath::Pow(x, y); },
+					[](float x, float y) { return std::pow(x, y); },
+					[](double x, double y) { return std::pow(x, y); }, false, FastMath::PowMaxAbsoluteError);
+				isAccurate &= CheckMathFunction("schlick", cosines,
+					[](float x, float) { return FastMath::Schlick(x); },
+					[](float x, float) { return std::pow(1.f - x, 5.f); },
+					[](double x, double) { return std::pow(1.0 - x, 5.0); }, false, FastMath::SchlickMaxAbsoluteError);
+
+				std::cout << "\n";
+				return isAccurate;
+			}
+
+			//Cook-Torrance inputs in rows of lanes, like the batches of the physically based pixel shader
+			struct CookTorranceInputs
+			{
+				enum Row { NormalX, NormalY, NormalZ, ViewX, ViewY, ViewZ, LightX, LightY, LightZ, F0, Roughness, NumRows };
+				std::vector<float> rows[NumRows]{};
+			};
+
+			//Specular plus Fresnel per pixel, so both outputs are compared
+			void EvaluateCookTorrance(const CookTorranceInputs& inputs, float* pOutput)
+			{
+				const auto& rows{ inputs.rows };
+				for (size_t i{}; i < rows[0].size(); ++i)
+				{
+					const Vector3 n{ rows[CookTorranceInputs::NormalX][i], rows[CookTorranceInputs::NormalY][i], rows[CookTorranceInputs::NormalZ][i] };
+					const Vector3 v{ rows[CookTorranceInputs::ViewX][i], rows[CookTorranceInputs::ViewY][i], rows[CookTorranceInputs::ViewZ][i] };
+					const Vector3 l{ rows[CookTorranceInputs::LightX][i], rows[CookTorranceInputs::LightY][i], rows[CookTorranceInputs::LightZ][i] };
+					const float f0{ rows[CookTorranceInputs::F0][i] };
+
+					ColorRGB fresnel{};
+					pOutput[i] = BRDF::CookTorrance(n, v, l, { f0, f0, f0 }, rows[CookTorranceInputs::Roughness][i], fresnel).r + fresnel.r;
+				}
+			}
+
+			template<typename SimdFloat>
+			void EvaluateCookTorrance(const CookTorranceInputs& inputs, float* pOutput)
+			{
+				using Float = typename SimdFloat::Float;
+				for (size_t i{}; i + SimdFloat::Width <= inputs.rows[0].size(); i += SimdFloat::Width)
+				{
+					const auto load = [&inputs, i](int row) { return SimdFloat::Load(inputs.rows[row].data() + i); };
+					const Float n[3]{ load(CookTorranceInputs::NormalX), load(CookTorranceInputs::NormalY), load(CookTorranceInputs::NormalZ) };
+					const Float v[3]{ load(CookTorranceInputs::ViewX), load(CookTorranceInputs::ViewY), load(CookTorranceInputs::ViewZ) };
+					const Float l[3]{ load(CookTorranceInputs::LightX), load(CookTorranceInputs::LightY), load(CookTorranceInputs::LightZ) };
+
+					Float fresnel{};
+					const Float specular{ BRDF::CookTorrance<SimdFloat>(n, v, l, load(CookTorranceInputs::F0), load(CookTorranceInputs::Roughness), fresnel) };
+					SimdFloat::Store(pOutput + i, SimdFloat::Add(specular, fresnel));
+				}
+			}
+
+			//Nanoseconds per pixel on one thread
+			template<typename Evaluate>
+			float MeasureCookTorranceCost(const CookTorranceInputs& inputs, std::vector<float>& output, const Evaluate& evaluate)
+			{
+				constexpr int numRepeats{ 20 };
+				const auto start{ std::chrono::high_resolution_clock::now() };
+				for (int repeat{}; repeat < numRepeats; ++repeat)
+				{
+					evaluate(inputs, output.data());
+				}
+				const auto end{ std::chrono::high_resolution_clock::now() };
+				return std::chrono::duration<float, std::nano>(end - start).count() / (float(numRepeats) * float(output.size()));
+			}
+
+			bool RunCookTorranceBenchmark()
+			{
+				//Relative above 1, absolute below; the lanes only differ from the scalar BRDF by rounding, which the GGX peak amplifies through n.h
+				constexpr double maxLaneError{ 1e-3 };
+				//Against a table that is 4 times finer in both directions and integrated with 4 times the samples
+				//Below the first cell center the table can't follow how steep the curve gets, so grazing n.v isn't checked
+				constexpr double maxLutError{ 2.5e-2 };
+
+				std::cout << "Cook-Torrance: SIMD lanes against the scalar BRDF, cost per pixel\n\n";
+
+				//Directions all over the sphere, so the lanes below the horizon are covered too; roughness from the renderer's minimum up
+				constexpr size_t numPixels{ 1 << 16 };
+				std::mt19937 generator{ 1234 };
+				std::uniform_real_distribution<float> uniform{ 0.f, 1.f };
+				CookTorranceInputs inputs{};
+				for (size_t i{}; i < numPixels; ++i)
+				{
+					for (int direction{}; direction < 3; ++direction)
+					{
+						const float z{ 2.f * uniform(generator) - 1.f };
+						const float phi{ 2.f * PI * uniform(generator) };
+						const float radius{ std::sqrt(1.f - z * z) };
+						inputs.rows[3 * direction].emplace_back(radius * std::cos(phi));
+						inputs.rows[3 * direction + 1].emplace_back(radius * std::sin(phi));
+						inputs.rows[3 * direction + 2].emplace_back(z);
+					}
+					inputs.rows[CookTorranceInputs::F0].emplace_back(uniform(generator));
+					inputs.rows[CookTorranceInputs::Roughness].emplace_back(0.1f + 0.9f * uniform(generator));
+				}
+
+				std::vector<float> expected(numPixels);
+				std::vector<float> output(numPixels);
+				EvaluateCookTorrance(inputs, expected.data());
+
+				std::cout << "  " << std::left << std::setw(9) << "lanes" << std::right << std::setw(12) << "max error" << std::setw(12) << "per pixel" << "\n";
+				std::cout << "  " << std::left << std::setw(9) << "scalar" << std::right << std::setw(12) << "-"
+					<< std::fixed << std::setprecision(2) << std::setw(9) << MeasureCookTorranceCost(inputs, output,
+						[](const CookTorranceInputs& inputs, float* pOutput) { EvaluateCookTorrance(inputs, pOutput); }) << " ns\n";
+
+				bool isAccurate{ true };
+				const auto checkLanes = [&](const char* pName, const auto& evaluate)
+					{
+						const float cost{ MeasureCookTorranceCost(inputs, output, evaluate) };
+						double maxError{};
+						for (size_t i{}; i < numPixels; ++i)
+						{
+							maxError = std::max(maxError, std::abs(double(output[i]) - double(expected[i])) / std::max(1.0, std::abs(double(expected[i]))));
+						}
+						isAccurate &= maxError <= maxLaneError;
+						std::cout << "  " << std::left << std::setw(9) << pName << std::right
+							<< std::scientific << std::setprecision(2) << std::setw(12) << maxError
+							<< std::fixed << std::setw(9) << cost << " ns" << (maxError <= maxLaneError ? "" : "  EXCEEDED") << "\n";
+					};
+				checkLanes("SSE2", [](const CookTorranceInputs& inputs, float* pOutput) { EvaluateCookTorrance<Simd::Float4>(inputs, pOutput); });
+				if (Simd::GetBestSupportedLevel() == Simd::Level::AVX2)
+					checkLanes("AVX2", [](const CookTorranceInputs& inputs, float* pOutput) { EvaluateCookTorrance<Simd::Float8>(inputs, pOutput); });
+
+				const auto buildStart{ std::chrono::high_resolution_clock::now() };
+				const SplitSumLut lut{ SplitSumLut::DefaultSize, SplitSumLut::DefaultNumSamples };
+				const float buildTime{ std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count() };
+				const SplitSumLut reference{ 4 * SplitSumLut::DefaultSize, 4 * SplitSumLut::DefaultNumSamples };
+
+				//Scale and bias are fractions of the incoming light, and the table should be close to one integrated at a much higher resolution
+				double maxLutDifference{};
+				bool isInRange{ true };
+				for (size_t i{}; i < numPixels; ++i)
+				{
+					const float nDotV{ 1.f / SplitSumLut::DefaultSize + (1.f - 1.f / SplitSumLut::DefaultSize) * uniform(generator) };
+					const float roughness{ 0.1f + 0.9f * uniform(generator) };
+					const Vector2 entry{ lut.Sample(nDotV, roughness) };
+					const Vector2 referenceEntry{ reference.Sample(nDotV, roughness) };
+					isInRange &= entry.x >= 0.f && entry.y >= 0.f && entry.x + entry.y <= 1.f + 1e-3f;
+					maxLutDifference = std::max({ maxLutDifference, double(std::abs(entry.x - referenceEntry.x)), double(std::abs(entry.y - referenceEntry.y)) });
+				}
+				isAccurate &= isInRange && maxLutDifference <= maxLutError;
+				std::cout << "\n  split-sum LUT " << SplitSumLut::DefaultSize << "x" << SplitSumLut::DefaultSize << ": built in " << std::setprecision(2) << buildTime << " ms"
+					<< ", max difference to " << reference.GetSize() << "x" << reference.GetSize() << " " << std::scientific << maxLutDifference << std::fixed
+					<< (isInRange ? "" : ", OUT OF RANGE") << (maxLutDifference <= maxLutError ? "" : ", EXCEEDED") << "\n\n";
+				return isAccurate;
+			}
+
+			//Attenuation and direction to the light for every surface point, 4 floats per point
+			void EvaluateLight(const Light& light, const std::vector<float>(&positions)[3], float* pOutput)
+			{
+				for (size_t i{}; i < positions[0].size(); ++i)
+				{
+					Vector3 toLight{};
+					pOutput[4 * i] = light.GetAttenuation({ positions[0][i], positions[1][i], positions[2][i] }, toLight);
+					for (int axis{}; axis < 3; ++axis)
+						pOutput[4 * i + 1 + axis] = toLight[axis];
+				}
+			}
+
+			template<typename SimdFloat>
+			void EvaluateLight(const Light& light, const std::vector<float>(&positions)[3], float* pOutput)
+			{
+				using Float = typename SimdFloat::Float;
+				for (size_t i{}; i + SimdFloat::Width <= positions[0].size(); i += SimdFloat::Width)
+				{
+					const Float position[3]{ SimdFloat::Load(positions[0].data() + i), SimdFloat::Load(positions[1].data() + i), SimdFloat::Load(positions[2].data() + i) };
+					Float toLight[3]{};
+					float rows[4][SimdFloat::Width]{};
+					SimdFloat::Store(rows[0], light.GetAttenuation<SimdFloat>(position, toLight));
+					for (int axis{}; axis < 3; ++axis)
+						SimdFloat::Store(rows[1 + axis], toLight[axis]);
+
+					for (int lane{}; lane < SimdFloat::Width; ++lane)
+					{
+						for (int row{}; row < 4; ++row)
+							pOutput[4 * (i + lane) + row] = rows[row][lane];
+					}
+				}
+			}
+
+			bool RunLightBenchmark()
+			{
+				//Both paths use the same reciprocal square root, so only rounding separates them
+				constexpr double maxLaneError{ 1e-5 };
+
+				std::cout << "Lights: SIMD lanes against the scalar attenuation, nothing lit past the range\n\n";
+
+				//Surface points up to twice the range away along every axis, most of them outside the range
+				constexpr size_t numPoints{ 1 << 16 };
+				constexpr float range{ 5.f };
+				const Vector3 lightPosition{ 1.f, 2.f, 3.f };
+				const Light lights[]
+				{
+					Light::CreatePoint(lightPosition, range, 1.f),
+					Light::CreateSpot(lightPosition, { 0.f, -1.f, 1.f }, range, 20.f, 35.f, 1.f)
+				};
+				std::mt19937 generator{ 4321 };
+				std::uniform_real_distribution<float> offset{ -2.f * range, 2.f * range };
+				std::vector<float> positions[3]{};
+				for (size_t i{}; i < numPoints; ++i)
+				{
+					for (int axis{}; axis < 3; ++axis)
+						positions[axis].emplace_back(lightPosition[axis] + offset(generator));
+				}
+
+				std::vector<float> expected(4 * numPoints);
+				std::vector<float> output(4 * numPoints);
+				bool isAccurate{ true };
+				for (const Light& light : lights)
+				{
+					const char* pLightName{ light.type == Light::Type::Spot ? "spot" : "point" };
+					EvaluateLight(light, positions, expected.data());
+
+					//The tile culling skips every light whose range doesn't reach a tile, which is only exact if nothing out there gets any light
+					//The margin is for the rounding of the distance itself, the culling bounds are a lot wider than that
+					bool isLitPastRange{ false };
+					for (size_t i{}; i < numPoints; ++i)
+					{
+						const Vector3 toPoint{ Vector3{ positions[0][i], positions[1][i], positions[2][i] } - lightPosition };
+						isLitPastRange |= toPoint.Magnitude() >= range * (1.f + 1e-5f) && expected[4 * i] != 0.f;
+					}
+					isAccurate &= !isLitPastRange;
+
+					const auto checkLanes = [&](const char* pName, const auto& evaluate)
+						{
+							evaluate(light, positions, output.data());
+							double maxError{};
+							for (size_t i{}; i < output.size(); ++i)
+							{
+								maxError = std::max(maxError, std::abs(double(output[i]) - double(expected[i])));
+							}
+							isAccurate &= maxError <= maxLaneError;
+							std::cout << "  " << std::left << std::setw(6) << pLightName << std::setw(6) << pName << std::right
+								<< std::scientific << std::setprecision(2) << std::setw(12) << maxError << std::fixed
+								<< (maxError <= maxLaneError ? "" : "  EXCEEDED") << (isLitPastRange ? "  LIT PAST RANGE" : "") << "\n";
+						};
+					checkLanes("SSE2", [](const Light& light, const std::vector<float>(&positions)[3], float* pOutput) { EvaluateLight<Simd::Float4>(light, positions, pOutput); });
+					if (Simd::GetBestSupportedLevel() == Simd::Level::AVX2)
+						checkLanes("AVX2", [](const Light& light, const std::vector<float>(&positions)[3], float* pOutput) { EvaluateLight<Simd::Float8>(light, positions, pOutput); });
+				}
+				std::cout << "\n";
+				return isAccurate;
+			}
+		}
+
+		int Run()
+		{
+			RunTextureLayoutBenchmark();
+			RunAnisotropicFilteringBenchmark();
+			//A fast math function outside its documented error bound fails the run, and so do SIMD lanes that disagree with the scalar BRDF or light
+			const bool isFastMathAccurate{ RunFastMathBenchmark() };
+			const bool isCookTorranceAccurate{ RunCookTorranceBenchmark() };
+			const bool isLightAccurate{ RunLightBenchmark() };
+			return isFastMathAccurate && isCookTorranceAccurate && isLightAccurate ? 0 : 1;
+		}
+	}
+}
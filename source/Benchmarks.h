@@ -0,0 +1,11 @@
+#pragma once
+
+namespace dae
+{
+	//CPU-only measurements of the software rasterizer's building blocks, they run without a window (start with --benchmark)
+	namespace Benchmarks
+	{
+		//Prints the results to the console, returns the process exit code
+		int Run();
+	}
+}
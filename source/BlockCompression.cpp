@@ -0,0 +1,322 @@
+#include "pch.h"
+#include "BlockCompression.h"
+#include <cmath>
+#include <cfloat>
+#include <atomic>
+
+namespace dae
+{
+	namespace BlockCompression
+	{
+		namespace
+		{
+			using Color = std::array<float, 3>;
+
+			uint16_t ToRGB565(const Color& color)
+			{
+				const auto quantize = [](float channel, int maxValue) { return std::clamp(int(channel * maxValue / 255.f + 0.5f), 0, maxValue); };
+				return uint16_t((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+			}
+
+			//Replicates the top bits into the bottom ones, so 31 and 63 map to 255 like the hardware does
+			Color FromRGB565(uint16_t color)
+			{
+				const int r{ (color >> 11) & 31 };
+				const int g{ (color >> 5) & 63 };
+				const int b{ color & 31 };
+				return { float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2)) };
+			}
+
+			//The colors a block with these endpoints shows, index 3 is transparent black in the 3 color mode
+			void CreateBC1Palette(uint16_t color0, uint16_t color1, uint32_t* pPalette)
+			{
+				const Color c0{ FromRGB565(color0) };
+				const Color c1{ FromRGB565(color1) };
+				const auto pack = [](int r, int g, int b, uint32_t alpha) { return uint32_t(r) | (uint32_t(g) << 8) | (uint32_t(b) << 16) | (alpha << 24); };
+
+				pPalette[0] = pack(int(c0[0]), int(c0[1]), int(c0[2]), 255);
+				pPalette[1] = pack(int(c1[0]), int(c1[1]), int(c1[2]), 255);
+				if (color0 > color1)
+				{
+					pPalette[2] = pack(int(2 * c0[0] + c1[0]) / 3, int(2 * c0[1] + c1[1]) / 3, int(2 * c0[2] + c1[2]) / 3, 255);
+					pPalette[3] = pack(int(c0[0] + 2 * c1[0]) / 3, int(c0[1] + 2 * c1[1]) / 3, int(c0[2] + 2 * c1[2]) / 3, 255);
+				}
+				else
+				{
+					pPalette[2] = pack(int(c0[0] + c1[0]) / 2, int(c0[1] + c1[1]) / 2, int(c0[2] + c1[2]) / 2, 255);
+					pPalette[3] = 0;
+				}
+			}
+
+			float GetSquaredDistance(const Color& color, uint32_t texel)
+			{
+				float distance{};
+				for (int channel{}; channel < 3; ++channel)
+				{
+					const float difference{ color[channel] - float((texel >> (channel * 8)) & 0xFF) };
+					distance += difference * difference;
+				}
+				return distance;
+			}
+
+			//Indices of the closest palette colors in the low 32 bits, the squared error as return value
+			float FindBC1Indices(const Color* pColors, uint16_t color0, uint16_t color1, uint32_t& indices)
+			{
+				uint32_t palette[4]{};
+				CreateBC1Palette(color0, color1, palette);
+				//Only the 4 color mode is written, so the transparent entry is never picked
+				const int numEntries{ color0 > color1 ? 4 : 3 };
+
+				indices = 0;
+				float error{};
+				for (int i{}; i < NumBlockTexels; ++i)
+				{
+					int bestIndex{};
+					float bestDistance{ GetSquaredDistance(pColors[i], palette[0]) };
+					for (int index{ 1 }; index < numEntries; ++index)
+					{
+						const float distance{ GetSquaredDistance(pColors[i], palette[index]) };
+						if (distance < bestDistance)
+						{
+							bestDistance = distance;
+							bestIndex = index;
+						}
+					}
+					indices |= uint32_t(bestIndex) << (2 * i);
+					error += bestDistance;
+				}
+				return error;
+			}
+
+			//Least squares endpoints for the given indices, false when the indices don't pin both endpoints down
+			bool RefineBC1Endpoints(const Color* pColors, uint32_t indices, Color& endpoint0, Color& endpoint1)
+			{
+				//How much of endpoint 0 every index blends in, the rest comes from endpoint 1
+				constexpr float weights0[4]{ 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+
+				float sum00{}, sum01{}, sum11{};
+				Color sumX0{}, sumX1{};
+				for (int i{}; i < NumBlockTexels; ++i)
+				{
+					const float a{ weights0[(indices >> (2 * i)) & 3] };
+					const float b{ 1.f - a };
+					sum00 += a * a;
+					sum01 += a * b;
+					sum11 += b * b;
+					for (int channel{}; channel < 3; ++channel)
+					{
+						sumX0[channel] += a * pColors[i][channel];
+						sumX1[channel] += b * pColors[i][channel];
+					}
+				}
+
+				const float determinant{ sum00 * sum11 - sum01 * sum01 };
+				if (std::abs(determinant) < 1e-6f)
+					return false;
+
+				const float invDeterminant{ 1.f / determinant };
+				for (int channel{}; channel < 3; ++channel)
+				{
+					endpoint0[channel] = std::clamp((sum11 * sumX0[channel] - sum01 * sumX1[channel]) * invDeterminant, 0.f, 255.f);
+					endpoint1[channel] = std::clamp((sum00 * sumX1[channel] - sum01 * sumX0[channel]) * invDeterminant, 0.f, 255.f);
+				}
+				return true;
+			}
+
+			//Same interpolation as the hardware for both BC4 modes
+			void CreateBC4Palette(uint8_t value0, uint8_t value1, uint8_t* pPalette)
+			{
+				pPalette[0] = value0;
+				pPalette[1] = value1;
+				if (value0 > value1)
+				{
+					for (int k{ 1 }; k < 7; ++k)
+						pPalette[k + 1] = uint8_t(((7 - k) * value0 + k * value1 + 3) / 7);
+				}
+				else
+				{
+					for (int k{ 1 }; k < 5; ++k)
+						pPalette[k + 1] = uint8_t(((5 - k) * value0 + k * value1 + 2) / 5);
+					pPalette[6] = 0;
+					pPalette[7] = 255;
+				}
+			}
+		}
+
+		uint64_t EncodeBC1(const uint32_t* pTexels)
+		{
+			Color colors[NumBlockTexels]{};
+			Color mean{};
+			for (int i{}; i < NumBlockTexels; ++i)
+			{
+				for (int channel{}; channel < 3; ++channel)
+				{
+					colors[i][channel] = float((pTexels[i] >> (channel * 8)) & 0xFF);
+					mean[channel] += colors[i][channel] / NumBlockTexels;
+				}
+			}
+
+			//The endpoints go on the principal axis of the colors, found with a few power iterations on the covariance
+			float covariance[3][3]{};
+			for (const Color& color : colors)
+			{
+				for (int row{}; row < 3; ++row)
+				{
+					for (int column{}; column < 3; ++column)
+						covariance[row][column] += (color[row] - mean[row]) * (color[column] - mean[column]);
+				}
+			}
+
+			Color axis{ 1.f, 1.f, 1.f };
+			for (int iteration{}; iteration < 4; ++iteration)
+			{
+				Color next{};
+				for (int row{}; row < 3; ++row)
+					next[row] = covariance[row][0] * axis[0] + covariance[row][1] * axis[1] + covariance[row][2] * axis[2];
+
+				const float largest{ std::max({ std::abs(next[0]), std::abs(next[1]), std::abs(next[2]) }) };
+				if (largest < 1e-6f)
+					break;
+				for (int channel{}; channel < 3; ++channel)
+					axis[channel] = next[channel] / largest;
+			}
+
+			//The texels furthest apart along the axis become the endpoints
+			int minIdx{};
+			int maxIdx{};
+			float minProjection{ FLT_MAX };
+			float maxProjection{ -FLT_MAX };
+			for (int i{}; i < NumBlockTexels; ++i)
+			{
+				const float projection{ colors[i][0] * axis[0] + colors[i][1] * axis[1] + colors[i][2] * axis[2] };
+				if (projection < minProjection)
+				{
+					minProjection = projection;
+					minIdx = i;
+				}
+				if (projection > maxProjection)
+				{
+					maxProjection = projection;
+					maxIdx = i;
+				}
+			}
+
+			uint16_t color0{ ToRGB565(colors[maxIdx]) };
+			uint16_t color1{ ToRGB565(colors[minIdx]) };
+			//The 4 color mode needs color0 > color1, the indices are only picked after the swap
+			if (color0 < color1)
+				std::swap(color0, color1);
+
+			uint32_t indices{};
+			float error{ FindBC1Indices(colors, color0, color1, indices) };
+
+			//One least squares pass on the chosen indices usually moves the endpoints closer to the real colors
+			Color endpoint0{};
+			Color endpoint1{};
+			if (color0 != color1 && RefineBC1Endpoints(colors, indices, endpoint0, endpoint1))
+			{
+				uint16_t refined0{ ToRGB565(endpoint0) };
+				uint16_t refined1{ ToRGB565(endpoint1) };
+				if (refined0 < refined1)
+					std::swap(refined0, refined1);
+
+				uint32_t refinedIndices{};
+				const float refinedError{ FindBC1Indices(colors, refined0, refined1, refinedIndices) };
+				if (refinedError < error)
+				{
+					color0 = refined0;
+					color1 = refined1;
+					indices = refinedIndices;
+				}
+			}
+
+			return uint64_t(color0) | (uint64_t(color1) << 16) | (uint64_t(indices) << 32);
+		}
+
+		void DecodeBC1(uint64_t block, uint32_t* pTexels)
+		{
+			uint32_t palette[4]{};
+			CreateBC1Palette(uint16_t(block), uint16_t(block >> 16), palette);
+
+			const uint32_t indices{ uint32_t(block >> 32) };
+			for (int i{}; i < NumBlockTexels; ++i)
+				pTexels[i] = palette[(indices >> (2 * i)) & 3];
+		}
+
+		uint64_t EncodeBC4(const uint8_t* pValues)
+		{
+			const auto [pMin, pMax] { std::minmax_element(pValues, pValues + NumBlockTexels) };
+			const uint8_t value0{ *pMax };
+			const uint8_t value1{ *pMin };
+
+			//The 8 value mode spreads the whole range evenly, which is what smooth maps need
+			uint8_t palette[8]{};
+			CreateBC4Palette(value0, value1, palette);
+
+			uint64_t indices{};
+			if (value0 != value1)
+			{
+				for (int i{}; i < NumBlockTexels; ++i)
+				{
+					int bestIndex{};
+					int bestDistance{ 256 };
+					for (int index{}; index < 8; ++index)
+					{
+						const int distance{ std::abs(int(pValues[i]) - int(palette[index])) };
+						if (distance < bestDistance)
+						{
+							bestDistance = distance;
+							bestIndex = index;
+						}
+					}
+					indices |= uint64_t(bestIndex) << (3 * i);
+				}
+			}
+
+			return uint64_t(value0) | (uint64_t(value1) << 8) | (indices << 16);
+		}
+
+		void DecodeBC4(uint64_t block, uint8_t* pValues)
+		{
+			uint8_t palette[8]{};
+			CreateBC4Palette(uint8_t(block), uint8_t(block >> 8), palette);
+
+			const uint64_t indices{ block >> 16 };
+			for (int i{}; i < NumBlockTexels; ++i)
+				pValues[i] = palette[(indices >> (3 * i)) & 7];
+		}
+
+		uint32_t CreateCacheId()
+		{
+			//0 is never handed out, so a zeroed level can't hit anything by accident
+			static std::atomic<uint32_t> nextId{ 1 };
+			return nextId++;
+		}
+
+		uint8_t ReconstructNormalZ(uint8_t x, uint8_t y)
+		{
+			const float normalX{ x / 255.f * 2.f - 1.f };
+			const float normalY{ y / 255.f * 2.f - 1.f };
+			const float normalZ{ std::sqrt(std::max(1.f - normalX * normalX - normalY * normalY, 0.f)) };
+			return uint8_t((normalZ * 0.5f + 0.5f) * 255.f + 0.5f);
+		}
+
+		uint32_t NormalizeNormal(uint32_t texel)
+		{
+			float normal[3]{};
+			for (int channel{}; channel < 3; ++channel)
+				normal[channel] = ((texel >> (channel * 8)) & 0xFF) / 255.f * 2.f - 1.f;
+			normal[2] = std::max(normal[2], 0.f);
+
+			const float length{ std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]) };
+			//A zero vector can only come from a broken map, it becomes the unperturbed normal
+			if (length < 1e-6f)
+				return (texel & 0xFF000000) | 0x00FF8080;
+
+			uint32_t normalized{ texel & 0xFF000000 };
+			for (int channel{}; channel < 3; ++channel)
+				normalized |= uint32_t((normal[channel] / length * 0.5f + 0.5f) * 255.f + 0.5f) << (channel * 8);
+			return normalized;
+		}
+	}
+}
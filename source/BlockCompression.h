@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <array>
+
+namespace dae
+{
+	//BC1 and BC4 blocks, the building blocks of the BC1/BC3/BC5 formats D3D can sample directly
+	//A block always covers 4x4 texels, stored row by row with texel 0 at the top-left
+	namespace BlockCompression
+	{
+		constexpr int BlockSize{ 4 };
+		constexpr int NumBlockTexels{ BlockSize * BlockSize };
+
+		//RGBA8 texels with red in the lowest byte, alpha is ignored
+		uint64_t EncodeBC1(const uint32_t* pTexels);
+		//Writes RGBA8 texels, alpha is 255 unless the block uses the transparent 3 color mode
+		void DecodeBC1(uint64_t block, uint32_t* pTexels);
+
+		//One 8 bit channel
+		uint64_t EncodeBC4(const uint8_t* pValues);
+		void DecodeBC4(uint64_t block, uint8_t* pValues);
+
+		//Blue of a unit length tangent-space normal from its red and green, all in unorm8
+		//BC5 only keeps two channels, the third one follows from the length
+		uint8_t ReconstructNormalZ(uint8_t x, uint8_t y);
+		//Rescales the unorm8 tangent-space normal in the rgb of an RGBA8 texel to unit length, z kept positive, alpha untouched
+		//Box-filtered mip levels come out shorter than unit length, and x and y are all BC5 keeps
+		uint32_t NormalizeNormal(uint32_t texel);
+
+		//Prefix for the keys of one texture level in a BlockCache, unique for the lifetime of the process
+		//Texture addresses can be reused after a delete, an id can't, so a cache never returns blocks of a texture that is gone
+		uint32_t CreateCacheId();
+
+		//Small direct-mapped cache of decoded blocks, meant to live in thread_local storage so sampling never locks
+		//Texel is the decoded texel type, the cache holds 2^EntryBits blocks
+		template<typename Texel, int EntryBits>
+		class BlockCache final
+		{
+		public:
+			//key has to be unique for every block of every texture; on a miss decode(pTexels) fills in the 16 texels
+			template<typename Decode>
+			const Texel* Find(uint64_t key, const Decode& decode)
+			{
+				//Fibonacci hashing, neighbouring blocks end up in different entries
+				Entry& entry{ m_Entries[(key * 0x9E3779B97F4A7C15ull) >> (64 - EntryBits)] };
+				if (entry.key != key)
+				{
+					decode(entry.texels);
+					entry.key = key;
+				}
+				return entry.texels;
+			}
+
+		private:
+			struct Entry
+			{
+				uint64_t key{ UINT64_MAX };
+				Texel texels[NumBlockTexels]{};
+			};
+			std::array<Entry, size_t(1) << EntryBits> m_Entries{};
+		};
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "Math.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <xmmintrin.h>
+
+namespace dae
+{
+	//Approximations for the per-pixel BRDF math, none of them calls into the C runtime
+	//Apart from Rsqrt they are plain float and integer arithmetic without branches, so loops over them vectorize
+	//The error bounds below are what RunFastMathBenchmark checks against the exact functions
+	namespace FastMath
+	{
+		constexpr float RsqrtMaxRelativeError{ 1e-6f };
+		//Over the whole positive float range, most of it is the rounding of the exponent part of large results
+		constexpr float Log2MaxAbsoluteError{ 1e-5f };
+		constexpr float Exp2MaxRelativeError{ 1e-5f };
+		//For exponents up to 128 and results above 1e-30, smaller results are off by less than PowMaxAbsoluteError
+		constexpr float PowMaxRelativeError{ 5e-5f };
+		constexpr float PowMaxAbsoluteError{ 1e-30f };
+		constexpr float SchlickMaxAbsoluteError{ 1e-6f };
+
+		//1 / sqrt(x) for x > 0: the 12 bit hardware estimate plus one Newton-Raphson step
+		inline float Rsqrt(float x)
+		{
+			const float estimate{ _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x))) };
+			return estimate * (1.5f - 0.5f * x * estimate * estimate);
+		}
+
+		//v / |v| with one multiply per component instead of a square root and three divides
+		inline Vector3 Normalize(const Vector3& v)
+		{
+			return v * Rsqrt(Vector3::Dot(v, v));
+		}
+
+		//log2(x) for x >= 0, 0 gives about -127 instead of -infinity
+		inline float Log2(float x)
+		{
+			//Splits x into 2^exponent * m with m in [sqrt(0.5), sqrt(2)), so the series below stays short
+			const int32_t bits{ std::bit_cast<int32_t>(x) - 0x3F3504F3 };
+			const float exponent{ float(bits >> 23) };
+			const float m{ std::bit_cast<float>((bits & 0x007FFFFF) + 0x3F3504F3) };
+
+			//log2(m) = 2 / ln(2) * atanh(t), |t| < 0.172
+			const float t{ (m - 1.f) / (m + 1.f) };
+			const float t2{ t * t };
+			const float result{ exponent + t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f + t2 * 0.412198583f))) };
+			//NaN has to stay NaN like in log2f, the bit split alone would turn it into a large finite number; compiles to a blend, not a branch
+			return x == x ? result : x;
+		}
+
+		//2^x, clamped to the normal float range
+		inline float Exp2(float x)
+		{
+			x = std::min(std::max(x, -126.f), 127.f);
+			//Adding and subtracting 1.5 * 2^23 rounds to the nearest integer without a conversion, the fraction is then in [-0.5, 0.5]
+			const float n{ (x + 12582912.f) - 12582912.f };
+			const float f{ x - n };
+			const float fraction{ 1.f + f * (0.693147181f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f + f * 0.00133335581f)))) };
+			return fraction * std::bit_cast<float>((int32_t(n) + 127) << 23);
+		}
+
+		//x^exponent for x >= 0, pow(0, 0) is 1 like powf
+		inline float Pow(float x, float exponent)
+		{
+			const float result{ Exp2(exponent * Log2(x)) };
+			//Log2(0) is only about -127, so small exponents would leave a visible result; also a blend, not a branch
+			return x == 0.f && exponent != 0.f ? 0.f : result;
+		}
+
+		//(1 - cosTheta)^5, the Schlick Fresnel weight; cosTheta in [0, 1], so nothing needs clamping
+		inline float Schlick(float cosTheta)
+		{
+			const float x{ 1.f - cosTheta };
+			const float x2{ x * x };
+			return x2 * x2 * x;
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#include "pch.h"
+#include "FrameArena.h"
+#include <new>
+
+namespace dae
+{
+	//Blocks are aligned for SIMD loads and stores
+	static constexpr size_t BlockAlignment{ 32 };
+
+	FrameArena::FrameArena(size_t capacity)
+		: m_Capacity{ capacity }
+	{
+		m_pBuffer = AllocateBlock(m_Capacity);
+	}
+
+	FrameArena::~FrameArena()
+	{
+		for (uint8_t* pBlock : m_pOverflowBlocks)
+		{
+			::operator delete[](pBlock, std::align_val_t{ BlockAlignment });
+		}
+		::operator delete[](m_pBuffer, std::align_val_t{ BlockAlignment });
+	}
+
+	void FrameArena::Reset()
+	{
+		if (!m_pOverflowBlocks.empty())
+		{
+			for (uint8_t* pBlock : m_pOverflowBlocks)
+			{
+				::operator delete[](pBlock, std::align_val_t{ BlockAlignment });
+			}
+			m_pOverflowBlocks.clear();
+			m_pOverflowBlock = nullptr;
+			m_OverflowCapacity = 0;
+			m_OverflowOffset = 0;
+
+			//Grow to what the last frame needed plus some headroom, so a slightly bigger frame doesn't overflow again
+			::operator delete[](m_pBuffer, std::align_val_t{ BlockAlignment });
+			m_Capacity = m_UsedBytes + m_UsedBytes / 4;
+			m_pBuffer = AllocateBlock(m_Capacity);
+		}
+
+		m_Offset = 0;
+		m_UsedBytes = 0;
+	}
+
+	void* FrameArena::AllocateBytes(size_t size, size_t alignment)
+	{
+		//Counts the worst case padding, so a buffer of m_UsedBytes always fits the same allocations again
+		m_UsedBytes += size + alignment - 1;
+
+		const size_t alignedOffset{ (m_Offset + alignment - 1) & ~(alignment - 1) };
+		if (alignedOffset + size <= m_Capacity)
+		{
+			m_Offset = alignedOffset + size;
+			return m_pBuffer + alignedOffset;
+		}
+
+		size_t alignedOverflowOffset{ (m_OverflowOffset + alignment - 1) & ~(alignment - 1) };
+		if (m_pOverflowBlock == nullptr || alignedOverflowOffset + size > m_OverflowCapacity)
+		{
+			m_OverflowCapacity = std::max(size, m_Capacity);
+			m_pOverflowBlock = AllocateBlock(m_OverflowCapacity);
+			m_pOverflowBlocks.emplace_back(m_pOverflowBlock);
+			alignedOverflowOffset = 0;
+		}
+
+		m_OverflowOffset = alignedOverflowOffset + size;
+		return m_pOverflowBlock + alignedOverflowOffset;
+	}
+
+	uint8_t* FrameArena::AllocateBlock(size_t size)
+	{
+		++m_NumHeapAllocations;
+		return static_cast<uint8_t*>(::operator new[](std::max(size, BlockAlignment), std::align_val_t{ BlockAlignment }));
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <type_traits>
+
+namespace dae
+{
+	//Linear allocator for data that only lives for one frame
+	//Reset() hands the same memory out again, so once it fits a whole frame it never touches the heap again
+	class FrameArena final
+	{
+	public:
+		explicit FrameArena(size_t capacity);
+		~FrameArena();
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena(FrameArena&&) noexcept = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+		FrameArena& operator=(FrameArena&&) noexcept = delete;
+
+		//Uninitialized memory for count objects, nothing is ever destructed so only trivial types are allowed
+		template<typename T>
+		T* Allocate(size_t count)
+		{
+			static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+			return static_cast<T*>(AllocateBytes(count * sizeof(T), alignof(T)));
+		}
+
+		//Invalidates everything handed out since the last Reset()
+		void Reset();
+
+		size_t GetCapacity() const { return m_Capacity; }
+		//Includes worst case alignment padding
+		size_t GetUsedBytes() const { return m_UsedBytes; }
+		//Total heap allocations since construction, this stops changing once the arena is big enough
+		uint32_t GetNumHeapAllocations() const { return m_NumHeapAllocations; }
+
+	private:
+		uint8_t* m_pBuffer{};
+		size_t m_Capacity{};
+		size_t m_Offset{};
+		size_t m_UsedBytes{};
+
+		//Blocks for a frame that didn't fit, the next Reset() replaces everything with one buffer that does
+		std::vector<uint8_t*> m_pOverflowBlocks{};
+		uint8_t* m_pOverflowBlock{};
+		size_t m_OverflowCapacity{};
+		size_t m_OverflowOffset{};
+
+		uint32_t m_NumHeapAllocations{};
+
+		void* AllocateBytes(size_t size, size_t alignment);
+		uint8_t* AllocateBlock(size_t size);
+	};
+}
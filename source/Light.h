@@ -0,0 +1,132 @@
+#pragma once
+#include "Math.h"
+#include "FastMath.h"
+#include <algorithm>
+
+namespace dae
+{
+	//A light of the renderer's light list; directional lights reach everything, point and spot lights nothing past their range
+	//Each one contributes color * intensity * GetAttenuation to the shading, the way the single hard-coded light used to with intensity 7
+	struct Light
+	{
+		enum class Type
+		{
+			Directional,
+			Point,
+			Spot
+		};
+
+		Type type{ Type::Directional };
+		//Point and spot, world space
+		Vector3 position{};
+		//Directional and spot, unit length, the way the light travels
+		Vector3 direction{ 0.f, 0.f, 1.f };
+		ColorRGB color{ 1.f, 1.f, 1.f };
+		float intensity{ 1.f };
+		//Point and spot: the falloff is exactly 0 from here on, which is what the tile culling relies on
+		float range{ 10.f };
+		//Spot: cosines of the half angles where the cone starts to fade and where it is dark
+		float innerConeCos{ 1.f };
+		float outerConeCos{ 0.f };
+		//Directional: the software path renders a shadow map for the first such light in the list, the others light everything they face
+		bool castsShadows{ false };
+
+		static Light CreateDirectional(const Vector3& direction, float intensity, const ColorRGB& color = { 1.f, 1.f, 1.f })
+		{
+			Light light{};
+			light.direction = direction.Normalized();
+			light.intensity = intensity;
+			light.color = color;
+			return light;
+		}
+
+		static Light CreatePoint(const Vector3& position, float range, float intensity, const ColorRGB& color = { 1.f, 1.f, 1.f })
+		{
+			Light light{};
+			light.type = Type::Point;
+			light.position = position;
+			light.range = range;
+			light.intensity = intensity;
+			light.color = color;
+			return light;
+		}
+
+		//Cone angles in degrees, measured from the direction to the edge
+		static Light CreateSpot(const Vector3& position, const Vector3& direction, float range, float innerAngle, float outerAngle, float intensity, const ColorRGB& color = { 1.f, 1.f, 1.f })
+		{
+			Light light{ CreatePoint(position, range, intensity, color) };
+			light.type = Type::Spot;
+			light.direction = direction.Normalized();
+			light.innerConeCos = std::cos(innerAngle * TO_RADIANS);
+			light.outerConeCos = std::cos(outerAngle * TO_RADIANS);
+			return light;
+		}
+
+		//Share of the intensity that reaches a surface point, toLight gets the unit direction from the point to the light
+		float GetAttenuation(const Vector3& surfacePosition, Vector3& toLight) const
+		{
+			if (type == Type::Directional)
+			{
+				toLight = -direction;
+				return 1.f;
+			}
+
+			const Vector3 offset{ position - surfacePosition };
+			const float distanceSquared{ std::max(Vector3::Dot(offset, offset), MinDistanceSquared) };
+			toLight = offset * FastMath::Rsqrt(distanceSquared);
+
+			//Full intensity at the light, smoothly down to 0 at the range; not the inverse square law, so an intensity means the same for every type
+			float attenuation{ Square(std::max(1.f - distanceSquared * (1.f / Square(range)), 0.f)) };
+			if (type == Type::Spot)
+			{
+				const float cone{ (-Vector3::Dot(direction, toLight) - outerConeCos) * (1.f / std::max(innerConeCos - outerConeCos, MinConeWidth)) };
+				attenuation *= Square(std::clamp(cone, 0.f, 1.f));
+			}
+			return attenuation;
+		}
+
+		//Same as above for a SIMD batch of surface points, in rows of lanes
+		template<typename SimdFloat, typename Float = typename SimdFloat::Float>
+		Float GetAttenuation(const Float(&surfacePosition)[3], Float(&toLight)[3]) const
+		{
+			if (type == Type::Directional)
+			{
+				for (int axis{}; axis < 3; ++axis)
+					toLight[axis] = SimdFloat::Set1(-direction[axis]);
+				return SimdFloat::Set1(1.f);
+			}
+
+			const auto dot = [](const Float(&a)[3], const Float(&b)[3])
+				{
+					return SimdFloat::Add(SimdFloat::Add(SimdFloat::Mul(a[0], b[0]), SimdFloat::Mul(a[1], b[1])), SimdFloat::Mul(a[2], b[2]));
+				};
+			const Float zero{ SimdFloat::Zero() };
+			const Float one{ SimdFloat::Set1(1.f) };
+
+			Float offset[3]{};
+			for (int axis{}; axis < 3; ++axis)
+				offset[axis] = SimdFloat::Sub(SimdFloat::Set1(position[axis]), surfacePosition[axis]);
+			const Float distanceSquared{ SimdFloat::Max(dot(offset, offset), SimdFloat::Set1(MinDistanceSquared)) };
+			const Float invDistance{ SimdFloat::Rsqrt(distanceSquared) };
+			for (int axis{}; axis < 3; ++axis)
+				toLight[axis] = SimdFloat::Mul(offset[axis], invDistance);
+
+			const Float falloff{ SimdFloat::Max(SimdFloat::Sub(one, SimdFloat::Mul(distanceSquared, SimdFloat::Set1(1.f / Square(range)))), zero) };
+			Float attenuation{ SimdFloat::Mul(falloff, falloff) };
+			if (type == Type::Spot)
+			{
+				const Float lightDirection[3]{ SimdFloat::Set1(-direction.x), SimdFloat::Set1(-direction.y), SimdFloat::Set1(-direction.z) };
+				const Float cone{ SimdFloat::Mul(SimdFloat::Sub(dot(lightDirection, toLight), SimdFloat::Set1(outerConeCos)),
+					SimdFloat::Set1(1.f / std::max(innerConeCos - outerConeCos, MinConeWidth))) };
+				const Float clamped{ SimdFloat::Min(SimdFloat::Max(cone, zero), one) };
+				attenuation = SimdFloat::Mul(attenuation, SimdFloat::Mul(clamped, clamped));
+			}
+			return attenuation;
+		}
+
+	private:
+		//A surface point exactly on the light still gets a direction, even if it's an arbitrary one
+		static constexpr float MinDistanceSquared{ 1e-8f };
+		static constexpr float MinConeWidth{ 1e-4f };
+	};
+}
@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "MaterialTextureSet.h"
+#include "BlockCompression.h"
+#include <numeric>
+#include <execution>
+
+using namespace dae::BlockCompression;
+
+MaterialTextureSet::MaterialTextureSet(const Texture* pDiffuse, const Texture* pNormal, const Texture* pSpecular, const Texture* pGlossiness,
+	Texture::Layout layout, bool useBlockCompression)
+{
+	for (int levelIdx{}; levelIdx < pDiffuse->GetNumMipLevels(); ++levelIdx)
+	{
+		MipLevel level{ nullptr, pDiffuse->GetWidth(levelIdx), pDiffuse->GetHeight(levelIdx) };
+		const size_t numTexels{ Texture::CreateTexelOffsets(layout, level.width, level.height, level.xOffsets, level.yOffsets) };
+		level.pTexels = new uint64_t[numTexels]{};
+		level.sizeInBytes = numTexels * sizeof(uint64_t);
+
+		//Maps with fewer levels repeat their last one
+		const auto getTexel = [&level, levelIdx](const Texture* pTexture, int x, int y) -> uint64_t
+			{
+				const int sourceLevelIdx{ std::min(levelIdx, pTexture->GetNumMipLevels() - 1) };
+				const int sourceX{ int(int64_t(x) * pTexture->GetWidth(sourceLevelIdx) / level.width) };
+				const int sourceY{ int(int64_t(y) * pTexture->GetHeight(sourceLevelIdx) / level.height) };
+				return pTexture->GetTexel(sourceLevelIdx, sourceX, sourceY);
+			};
+
+		for (int y{}; y < level.height; ++y)
+		{
+			for (int x{}; x < level.width; ++x)
+			{
+				const uint64_t diffuseGloss{ (getTexel(pDiffuse, x, y) & 0x00FFFFFF) | ((getTexel(pGlossiness, x, y) & 0xFF) << 24) };
+				const uint64_t normalSpecular{ (NormalizeNormal(uint32_t(getTexel(pNormal, x, y))) & 0x0000FFFF) | ((getTexel(pSpecular, x, y) & 0xFF) << 24) };
+				level.pTexels[level.xOffsets[x] + level.yOffsets[y]] = diffuseGloss | (normalSpecular << 32);
+			}
+		}
+
+		if (useBlockCompression)
+			CompressMipLevel(level, layout);
+		m_MipLevels.emplace_back(std::move(level));
+	}
+}
+
+MaterialTextureSet::~MaterialTextureSet()
+{
+	for (const MipLevel& level : m_MipLevels)
+	{
+		delete[] level.pTexels;
+		delete[] level.pBlocks;
+	}
+}
+
+size_t MaterialTextureSet::GetMemorySize() const
+{
+	size_t size{};
+	for (int levelIdx{ GetFirstResidentLevel() }; levelIdx < int(m_MipLevels.size()); ++levelIdx)
+	{
+		size += m_MipLevels[levelIdx].sizeInBytes;
+	}
+	return size;
+}
+
+const void* MaterialTextureSet::GetLevelData(int levelIdx) const
+{
+	const MipLevel& level{ m_MipLevels[levelIdx] };
+	if (level.pBlocks)
+		return level.pBlocks;
+	return level.pTexels;
+}
+
+void MaterialTextureSet::ReleaseLevel(int levelIdx)
+{
+	MipLevel& level{ m_MipLevels[levelIdx] };
+	delete[] level.pTexels;
+	delete[] level.pBlocks;
+	level.pTexels = nullptr;
+	level.pBlocks = nullptr;
+}
+
+void* MaterialTextureSet::AllocateLevel(int levelIdx)
+{
+	//Compressed levels have a cache id, uncompressed ones never get one
+	MipLevel& level{ m_MipLevels[levelIdx] };
+	if (level.cacheId != 0)
+	{
+		level.pBlocks = new uint64_t[level.sizeInBytes / sizeof(uint64_t)];
+		return level.pBlocks;
+	}
+	level.pTexels = new uint64_t[level.sizeInBytes / sizeof(uint64_t)];
+	return level.pTexels;
+}
+
+void MaterialTextureSet::CompressMipLevel(MipLevel& level, Texture::Layout layout)
+{
+	const int numBlocksX{ (level.width + BlockSize - 1) / BlockSize };
+	const int numBlocksY{ (level.height + BlockSize - 1) / BlockSize };
+	std::vector<uint32_t> xOffsets{};
+	std::vector<uint32_t> yOffsets{};
+	const size_t numBlocks{ Texture::CreateTexelOffsets(layout, numBlocksX, numBlocksY, xOffsets, yOffsets) };
+	uint64_t* pBlocks{ new uint64_t[numBlocks * BlockWords]{} };
+
+	//Block rows are independent, so they are spread over all cores
+	std::vector<int> blockRows(numBlocksY);
+	std::iota(blockRows.begin(), blockRows.end(), 0);
+	std::for_each(std::execution::par, blockRows.begin(), blockRows.end(), [&level, &xOffsets, &yOffsets, numBlocksX, pBlocks](int by)
+		{
+			for (int bx{}; bx < numBlocksX; ++bx)
+			{
+				//Levels smaller than a block repeat their last row and column
+				uint32_t diffuse[NumBlockTexels]{};
+				uint8_t channels[4][NumBlockTexels]{};
+				for (int i{}; i < NumBlockTexels; ++i)
+				{
+					const int x{ std::min(bx * BlockSize + i % BlockSize, level.width - 1) };
+					const int y{ std::min(by * BlockSize + i / BlockSize, level.height - 1) };
+					const uint64_t texel{ level.pTexels[level.xOffsets[x] + level.yOffsets[y]] };
+					diffuse[i] = uint32_t(texel);
+					channels[0][i] = uint8_t(texel >> 24);
+					channels[1][i] = uint8_t(texel >> 32);
+					channels[2][i] = uint8_t(texel >> 40);
+					channels[3][i] = uint8_t(texel >> 56);
+				}
+
+				uint64_t* pBlock{ pBlocks + size_t(xOffsets[bx] + yOffsets[by]) * BlockWords };
+				pBlock[0] = EncodeBC1(diffuse);
+				for (int channel{}; channel < 4; ++channel)
+					pBlock[channel + 1] = EncodeBC4(channels[channel]);
+			}
+		});
+
+	delete[] level.pTexels;
+	level.pTexels = nullptr;
+	level.pBlocks = pBlocks;
+	level.cacheId = CreateCacheId();
+	level.sizeInBytes = numBlocks * BlockWords * sizeof(uint64_t);
+	level.xOffsets = std::move(xOffsets);
+	level.yOffsets = std::move(yOffsets);
+}
+
+uint64_t MaterialTextureSet::GetCompressedTexel(const MipLevel& level, int x, int y, bool decodeNormal)
+{
+	thread_local BlockCache<uint64_t, 6> blockCache{};
+
+	const uint32_t blockIdx{ level.xOffsets[uint32_t(x) / BlockSize] + level.yOffsets[uint32_t(y) / BlockSize] };
+	const uint64_t key{ (uint64_t(level.cacheId) << 32) | blockIdx | (decodeNormal ? 0 : 1ull << 63) };
+	const uint64_t* pTexels{ blockCache.Find(key, [&level, blockIdx, decodeNormal](uint64_t* pDecoded)
+		{
+			const uint64_t* pBlock{ level.pBlocks + size_t(blockIdx) * BlockWords };
+			uint32_t diffuse[NumBlockTexels]{};
+			uint8_t channels[4][NumBlockTexels]{};
+			DecodeBC1(pBlock[0], diffuse);
+			DecodeBC4(pBlock[1], channels[0]);
+			if (decodeNormal)
+			{
+				DecodeBC4(pBlock[2], channels[1]);
+				DecodeBC4(pBlock[3], channels[2]);
+			}
+			DecodeBC4(pBlock[4], channels[3]);
+
+			for (int i{}; i < NumBlockTexels; ++i)
+			{
+				const uint64_t diffuseGloss{ (diffuse[i] & 0x00FFFFFF) | (uint64_t(channels[0][i]) << 24) };
+				const uint64_t normalSpecular{ channels[1][i] | (uint64_t(channels[2][i]) << 8) | (uint64_t(channels[3][i]) << 24) };
+				pDecoded[i] = diffuseGloss | (normalSpecular << 32);
+			}
+		}) };
+	return pTexels[(y % BlockSize) * BlockSize + x % BlockSize];
+}
@@ -0,0 +1,218 @@
+#pragma once
+#include "Texture.h"
+#include <emmintrin.h>
+
+//Everything the vehicle BRDF reads at one uv, channels in [0, 1]
+struct MaterialSample
+{
+	dae::ColorRGB diffuse{};
+	//Unit tangent-space normal, straight up when the normal map wasn't sampled
+	dae::Vector3 normal{ 0.f, 0.f, 1.f };
+	float glossiness{};
+	float specular{};
+};
+
+//The vehicle maps interleaved into one 8 byte texel: diffuse rgb + glossiness, then normal x and y + specular
+//The normals are rescaled to unit length at build time and z is rebuilt per sample from the filtered x and y, so the byte in between stays 0
+//One address computation and one filter pass then fetch all four maps at once
+class MaterialTextureSet final : public StreamedMipChain
+{
+public:
+	//The maps are expected to have the same size, a smaller one is stretched with point sampling
+	//Block compression stores every 4x4 block as BC1 diffuse plus BC4 glossiness, normal x, normal y and specular:
+	//40 instead of 128 bytes, decoded on demand through a per-thread block cache
+	MaterialTextureSet(const Texture* pDiffuse, const Texture* pNormal, const Texture* pSpecular, const Texture* pGlossiness,
+		Texture::Layout layout = Texture::Layout::Swizzled, bool useBlockCompression = false);
+	~MaterialTextureSet() override;
+
+	MaterialTextureSet(const MaterialTextureSet&) = delete;
+	MaterialTextureSet(MaterialTextureSet&&) noexcept = delete;
+	MaterialTextureSet& operator=(const MaterialTextureSet&) = delete;
+	MaterialTextureSet& operator=(MaterialTextureSet&&) noexcept = delete;
+
+	//Same level selection and probes as Texture::SampleGrad
+	//Without SampleNormal the normal blocks aren't decoded and the normal isn't rebuilt
+	template<bool SampleNormal = true, typename Sampler>
+	MaterialSample SampleGrad(const Sampler& sampler, const dae::Vector2& uv, const dae::Vector2& uvDx, const dae::Vector2& uvDy) const;
+
+	//Bytes of texel data in memory, all resident levels together
+	size_t GetMemorySize() const;
+	int GetNumMipLevels() const override { return int(m_MipLevels.size()); }
+
+private:
+	struct MipLevel
+	{
+		//nullptr once the level is block-compressed or paged out
+		uint64_t* pTexels{ nullptr };
+		int width{};
+		int height{};
+		//Same addressing as Texture, compressed levels address blocks of BlockWords words
+		std::vector<uint32_t> xOffsets{};
+		std::vector<uint32_t> yOffsets{};
+		size_t sizeInBytes{};
+
+		uint64_t* pBlocks{ nullptr };
+		uint32_t cacheId{};
+	};
+	static constexpr int BlockWords{ 5 };
+	std::vector<MipLevel> m_MipLevels{};
+
+	size_t GetLevelSize(int levelIdx) const override { return m_MipLevels[levelIdx].sizeInBytes; }
+	const void* GetLevelData(int levelIdx) const override;
+	void ReleaseLevel(int levelIdx) override;
+	void* AllocateLevel(int levelIdx) override;
+
+	//Adds the trilinear result around lod times weight to the 8 channels
+	template<bool SampleNormal, typename Sampler>
+	void AccumulateTrilinear(const dae::Vector2& uv, float lod, float weight, uint64_t borderTexel, float* pChannels) const;
+	//Writes the 8 channels of a level in [0, 255], in texel order
+	template<bool SampleNormal, typename Sampler>
+	void SampleLevel(const dae::Vector2& uv, int levelIdx, uint64_t borderTexel, float* pChannels) const;
+	//Coordinates have gone through AddressTexel already, -1 stands for the border
+	template<bool SampleNormal, typename Sampler>
+	static uint64_t FetchTexel(const MipLevel& level, int x, int y, uint64_t borderTexel);
+	//Blocks decoded without the normal get their own cache entries, so a later fetch that wants it never sees the gap
+	static uint64_t GetCompressedTexel(const MipLevel& level, int x, int y, bool decodeNormal);
+	static void CompressMipLevel(MipLevel& level, Texture::Layout layout);
+
+	//8 unorm bytes to two float4s, SSE2 only has the zero-extending unpacks
+	static void UnpackChannels(uint64_t texel, __m128& low, __m128& high)
+	{
+		const __m128i zero{ _mm_setzero_si128() };
+		const __m128i words{ _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&texel)), zero) };
+		low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+		high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero));
+	}
+};
+
+template<bool SampleNormal, typename Sampler>
+MaterialSample MaterialTextureSet::SampleGrad(const Sampler& sampler, const dae::Vector2& uv, const dae::Vector2& uvDx, const dae::Vector2& uvDy) const
+{
+	//The border color goes into both halves, so every map sees it
+	uint64_t borderTexel{};
+	if constexpr (Sampler::hasBorder)
+		borderTexel = uint64_t(sampler.GetBorderTexel()) * 0x100000001ull;
+
+	const MipLevel& base{ m_MipLevels[0] };
+	const int numLevels{ int(m_MipLevels.size()) };
+	alignas(16) float channels[8]{};
+	if constexpr (Sampler::filter == TextureFilter::Point)
+	{
+		const float lod{ Texture::CalculateLod(uvDx, uvDy, base.width, base.height, numLevels) };
+		SampleLevel<SampleNormal, Sampler>(uv, int(RequestLod(lod + 0.5f)), borderTexel, channels);
+	}
+	else if constexpr (Sampler::filter == TextureFilter::Linear)
+	{
+		const float lod{ Texture::CalculateLod(uvDx, uvDy, base.width, base.height, numLevels) };
+		AccumulateTrilinear<SampleNormal, Sampler>(uv, RequestLod(lod), 1.f, borderTexel, channels);
+	}
+	else
+	{
+		//Same probes as Texture's anisotropic filter
+		float lod{};
+		dae::Vector2 probeStep{};
+		const int numProbes{ Texture::CalculateAnisotropy(uvDx, uvDy, base.width, base.height, numLevels, sampler.maxAnisotropy, lod, probeStep) };
+		lod = RequestLod(lod);
+		const float weight{ 1.f / float(numProbes) };
+		dae::Vector2 probeUV{ uv - probeStep * (0.5f * float(numProbes - 1)) };
+		for (int i{}; i < numProbes; ++i)
+		{
+			AccumulateTrilinear<SampleNormal, Sampler>(probeUV, lod, weight, borderTexel, channels);
+			probeUV += probeStep;
+		}
+	}
+
+	constexpr float toUnorm{ 1.f / 255.f };
+	MaterialSample material
+	{
+		{ channels[0] * toUnorm, channels[1] * toUnorm, channels[2] * toUnorm },
+		{ 0.f, 0.f, 1.f },
+		channels[3] * toUnorm,
+		channels[7] * toUnorm
+	};
+	if constexpr (SampleNormal)
+	{
+		//One square root per sample instead of one per decoded texel, and filtering x and y keeps the result close to unit length
+		const float x{ channels[4] * (2.f * toUnorm) - 1.f };
+		const float y{ channels[5] * (2.f * toUnorm) - 1.f };
+		material.normal = { x, y, std::sqrt(std::max(1.f - x * x - y * y, 0.f)) };
+	}
+	return material;
+}
+
+template<bool SampleNormal, typename Sampler>
+void MaterialTextureSet::AccumulateTrilinear(const dae::Vector2& uv, float lod, float weight, uint64_t borderTexel, float* pChannels) const
+{
+	const int levelIdx{ int(lod) };
+	const float blend{ lod - float(levelIdx) };
+
+	alignas(16) float levelChannels[8];
+	SampleLevel<SampleNormal, Sampler>(uv, levelIdx, borderTexel, levelChannels);
+	if (blend != 0.f)
+	{
+		alignas(16) float nextChannels[8];
+		SampleLevel<SampleNormal, Sampler>(uv, levelIdx + 1, borderTexel, nextChannels);
+		for (int i{}; i < 8; ++i)
+			levelChannels[i] += (nextChannels[i] - levelChannels[i]) * blend;
+	}
+
+	for (int i{}; i < 8; ++i)
+		pChannels[i] += levelChannels[i] * weight;
+}
+
+template<bool SampleNormal, typename Sampler>
+uint64_t MaterialTextureSet::FetchTexel(const MipLevel& level, int x, int y, uint64_t borderTexel)
+{
+	if constexpr (Sampler::hasBorder)
+	{
+		if (x < 0 || y < 0)
+			return borderTexel;
+	}
+	if (level.pBlocks)
+		return GetCompressedTexel(level, x, y, SampleNormal);
+	return level.pTexels[level.xOffsets[x] + level.yOffsets[y]];
+}
+
+template<bool SampleNormal, typename Sampler>
+void MaterialTextureSet::SampleLevel(const dae::Vector2& uv, int levelIdx, uint64_t borderTexel, float* pChannels) const
+{
+	const MipLevel& level{ m_MipLevels[levelIdx] };
+
+	__m128 low{};
+	__m128 high{};
+	if constexpr (Sampler::filter == TextureFilter::Point)
+	{
+		const int x{ AddressTexel<Sampler::addressU>(FloorToTexel(uv.x * level.width), level.width) };
+		const int y{ AddressTexel<Sampler::addressV>(FloorToTexel(uv.y * level.height), level.height) };
+		UnpackChannels(FetchTexel<SampleNormal, Sampler>(level, x, y, borderTexel), low, high);
+	}
+	else
+	{
+		//Same footprint and weights as Texture's bilinear filter, for all 8 channels at once
+		const float x{ uv.x * level.width - 0.5f };
+		const float y{ uv.y * level.height - 0.5f };
+		const int x0{ FloorToTexel(x) };
+		const int y0{ FloorToTexel(y) };
+		const float dx{ x - float(x0) };
+		const float dy{ y - float(y0) };
+
+		const int xs[2]{ AddressTexel<Sampler::addressU>(x0, level.width), AddressTexel<Sampler::addressU>(x0 + 1, level.width) };
+		const int ys[2]{ AddressTexel<Sampler::addressV>(y0, level.height), AddressTexel<Sampler::addressV>(y0 + 1, level.height) };
+		const float weights[4]{ (1.f - dx) * (1.f - dy), dx * (1.f - dy), (1.f - dx) * dy, dx * dy };
+
+		low = _mm_setzero_ps();
+		high = _mm_setzero_ps();
+		for (int i{}; i < 4; ++i)
+		{
+			__m128 texelLow{};
+			__m128 texelHigh{};
+			UnpackChannels(FetchTexel<SampleNormal, Sampler>(level, xs[i % 2], ys[i / 2], borderTexel), texelLow, texelHigh);
+			const __m128 weight{ _mm_set1_ps(weights[i]) };
+			low = _mm_add_ps(low, _mm_mul_ps(weight, texelLow));
+			high = _mm_add_ps(high, _mm_mul_ps(weight, texelHigh));
+		}
+	}
+
+	_mm_storeu_ps(pChannels, low);
+	_mm_storeu_ps(pChannels + 4, high);
+}
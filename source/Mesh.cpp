@@ -13,6 +13,7 @@ Mesh::Mesh(ID3D11Device* pDevice, const std::vector<Vertex>& vertices, const std
 	m_pTechnique = m_pEffect->GetTechnique();
 	m_WorldMatrix = dae::Matrix::CreateScale({ 1.0f,1.0f,1.0f }) * dae::Matrix::CreateRotation({ 0.0f,0.0f,0.0f }) * dae::Matrix::CreateTranslation(pos);
 	m_PrimitiveTopology = PrimitiveTopology::TriangleList;
+	BuildVertexStreams();
 
 	//Create Vertex Layout
 	static constexpr uint32_t numElements{ 5 };
@@ -84,13 +85,10 @@ Mesh::Mesh(ID3D11Device* pDevice, const std::vector<Vertex>& vertices, const std
 		return;
 }
 
-void Mesh::UpdateFilterMode(bool isUsingDX)
+void Mesh::UpdateFilterMode()
 {
-	if(isUsingDX)
-		m_FilteringTechnique = static_cast<FilteringTechnique>((static_cast<int>(m_FilteringTechnique) + 1) % 3);
-	else
-		m_FilteringTechnique = static_cast<FilteringTechnique>((static_cast<int>(m_FilteringTechnique) + 1) % 2);
-
+	//Both renderers support all three, the software path has its own anisotropic sampler
+	m_FilteringTechnique = static_cast<FilteringTechnique>((static_cast<int>(m_FilteringTechnique) + 1) % 3);
 }
 
 std::string Mesh::GetFilterModeName()
@@ -228,7 +226,55 @@ void Mesh::Update(const dae::Timer* pTimer, const dae::Matrix& worldViewProj, co
 	m_pEffect->Update(WVPMatrix, worldMatrix, invViewMatrix);
 }
 
-void Mesh::SetVerticesOut(const std::vector<Vertex_Out>& vOut)
+void Mesh::BuildVertexStreams()
 {
-	m_Vertices_out = vOut;
+	const size_t numVertices{ m_Vertices.size() };
+	const size_t paddedSize{ (numVertices + VertexStreams::Padding - 1) / VertexStreams::Padding * VertexStreams::Padding };
+
+	m_VertexStreams.numVertices = numVertices;
+	std::vector<float>* streams[]
+	{
+		&m_VertexStreams.positionX, &m_VertexStreams.positionY, &m_VertexStreams.positionZ,
+		&m_VertexStreams.u, &m_VertexStreams.v,
+		&m_VertexStreams.normalX, &m_VertexStreams.normalY, &m_VertexStreams.normalZ,
+		&m_VertexStreams.tangentX, &m_VertexStreams.tangentY, &m_VertexStreams.tangentZ
+	};
+	for (std::vector<float>* pStream : streams)
+	{
+		pStream->assign(paddedSize, 0.f);
+	}
+
+	for (size_t i{}; i < numVertices; ++i)
+	{
+		const Vertex& vertex{ m_Vertices[i] };
+		m_VertexStreams.positionX[i] = vertex.position.x;
+		m_VertexStreams.positionY[i] = vertex.position.y;
+		m_VertexStreams.positionZ[i] = vertex.position.z;
+		m_VertexStreams.u[i] = vertex.uv.x;
+		m_VertexStreams.v[i] = vertex.uv.y;
+		m_VertexStreams.normalX[i] = vertex.normal.x;
+		m_VertexStreams.normalY[i] = vertex.normal.y;
+		m_VertexStreams.normalZ[i] = vertex.normal.z;
+		m_VertexStreams.tangentX[i] = vertex.tangent.x;
+		m_VertexStreams.tangentY[i] = vertex.tangent.y;
+		m_VertexStreams.tangentZ[i] = vertex.tangent.z;
+	}
+
+	//Centered on the bounding box, a little larger than the tightest sphere but it only sets the shadow map's extent
+	dae::Vector3 boundsMin{ FLT_MAX, FLT_MAX, FLT_MAX };
+	dae::Vector3 boundsMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (const Vertex& vertex : m_Vertices)
+	{
+		for (int axis{}; axis < 3; ++axis)
+		{
+			boundsMin[axis] = std::min(boundsMin[axis], vertex.position[axis]);
+			boundsMax[axis] = std::max(boundsMax[axis], vertex.position[axis]);
+		}
+	}
+	m_VertexStreams.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	m_VertexStreams.boundsRadius = 0.f;
+	for (const Vertex& vertex : m_Vertices)
+	{
+		m_VertexStreams.boundsRadius = std::max(m_VertexStreams.boundsRadius, (vertex.position - m_VertexStreams.boundsCenter).Magnitude());
+	}
 }
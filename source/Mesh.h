@@ -20,7 +20,31 @@ struct Vertex_Out
 	dae::Vector2 uv{};
 	dae::Vector3 normal{};
 	dae::Vector3 tangent{};
-	dae::Vector3 viewDirection{};
+	//Where point and spot lights are measured from, and the view direction
+	dae::Vector3 worldPosition{};
+};
+
+//Input of the software vertex pipeline, one array per component so 4 or 8 vertices can be loaded at once
+//Every array is zero padded to a multiple of Padding, so the SIMD transform never needs a scalar tail
+struct VertexStreams
+{
+	static constexpr size_t Padding{ 8 };
+
+	size_t numVertices{};
+	std::vector<float> positionX{};
+	std::vector<float> positionY{};
+	std::vector<float> positionZ{};
+	std::vector<float> u{};
+	std::vector<float> v{};
+	std::vector<float> normalX{};
+	std::vector<float> normalY{};
+	std::vector<float> normalZ{};
+	std::vector<float> tangentX{};
+	std::vector<float> tangentY{};
+	std::vector<float> tangentZ{};
+	//Sphere around all positions in object space, the shadow map is fitted to it
+	dae::Vector3 boundsCenter{};
+	float boundsRadius{};
 };
 
 enum class PrimitiveTopology
@@ -58,7 +82,7 @@ public:
 	void Render(ID3D11DeviceContext* pDeviceContext);
 	void Update(const dae::Timer* pTimer, const dae::Matrix& worldViewProj, const dae::Matrix& invView, bool enableRotation = true);
 
-	void UpdateFilterMode(bool isUsingDX);
+	void UpdateFilterMode();
 	std::string GetFilterModeName();
 	FilteringTechnique GetFilterMode() const { return m_FilteringTechnique; }
 
@@ -72,8 +96,7 @@ public:
 	dae::Matrix GetWorldMatrix()const { return m_WorldMatrix; }
 
 	std::vector<Vertex>& GetVertices() { return m_Vertices; }
-	std::vector<Vertex_Out>& GetVerticesOut() { return m_Vertices_out; }
-	void SetVerticesOut(const std::vector<Vertex_Out>& vOut);
+	const VertexStreams& GetVertexStreams() const { return m_VertexStreams; }
 
 	std::vector<uint32_t>& GetIndices() { return m_Indices; }
 	PrimitiveTopology GetPrimitiveTopology()const { return m_PrimitiveTopology; }
@@ -90,8 +113,7 @@ private:
 	std::vector<Vertex> m_Vertices{};
 	std::vector<uint32_t> m_Indices{};
 	PrimitiveTopology m_PrimitiveTopology{ PrimitiveTopology::TriangleStrip };
-
-	std::vector<Vertex_Out> m_Vertices_out{};
+	VertexStreams m_VertexStreams{};
 
 
 
@@ -99,5 +121,7 @@ private:
 	CullMode m_CullMode{ CullMode::None };
 	std::string m_pTechniqueName{ "PointFiltering" };
 	bool m_IsEnabled{ true };
+
+	void BuildVertexStreams();
 };
 
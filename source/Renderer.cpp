@@ -2,8 +2,20 @@
 #include "Renderer.h"
 #include "Utils.h"
 #include "BRDF.h"
+#include <cassert>
+#include <chrono>
+#include <filesystem>
 namespace dae {
 
+	namespace
+	{
+		//Same as gAmbient in VehicleShader.fx
+		const ColorRGB Ambient{ 0.025f,0.025f,0.025f };
+
+		//Below this the GGX peak is narrower than the float precision of n.h, and glossy texels turn into single-pixel sparkles that depend on rounding
+		constexpr float MinRoughness{ 0.1f };
+	}
+
 	Renderer::Renderer(SDL_Window* pWindow) :
 		m_pWindow(pWindow)
 	{
@@ -33,28 +45,116 @@ namespace dae {
 		{
 			m_pDepthBufferPixels[i] = FLT_MAX;
 		}
+		m_pVisibilityBufferPixels = new uint32_t[m_Width * m_Height]{};
+
+		m_pThreadPool = new ThreadPool{};
+		m_SimdLevel = Simd::GetBestSupportedLevel();
+		m_MaxSimdLevel = m_SimdLevel;
+		std::cout << "Software rasterizer uses " << m_pThreadPool->GetNumThreads() << " threads, SIMD: " << Simd::GetLevelName(m_SimdLevel) << "\n";
+		m_NumTilesX = (m_Width + TileSize - 1) / TileSize;
+		m_NumTilesY = (m_Height + TileSize - 1) / TileSize;
+		m_TileBins.resize(size_t(m_NumTilesX) * m_NumTilesY);
+		m_TileLights.resize(m_TileBins.size());
+		m_HiZTiles.resize(m_TileBins.size());
+		m_NumHiZBlocksX = (m_Width + HiZBlockSize - 1) / HiZBlockSize;
+		m_NumHiZBlocksY = (m_Height + HiZBlockSize - 1) / HiZBlockSize;
+		m_HiZBlocks.resize(size_t(m_NumHiZBlocksX) * m_NumHiZBlocksY);
+		m_HiZDirty.resize(m_HiZBlocks.size());
+		m_pShadowMapPixels = new float[ShadowMapSize * ShadowMapSize];
+		m_ShadowTileBins.resize(NumShadowTiles * NumShadowTiles);
 
 		m_pCamera = new Camera{ {0,0,0},45,float(m_Width) / float(m_Height) };
+		m_Lights.emplace_back(Light::CreateDirectional({ .577f,-.577f,.577f }, 7.f));
+		m_Lights.back().castsShadows = true;
 
 		//Dx
 
+		const auto loadStart{ std::chrono::high_resolution_clock::now() };
+
+		//Decoding and compressing the textures takes longer than parsing the models, so it all starts on the workers first
+		//Block-compressed on both sides, the normal map keeps only x and y and the shaders rebuild z
+		//The vehicle maps stay RGBA8 until the material set has read them, so its own block compression starts from the full quality texels
+		const auto decode = [this](const char* path, Texture::Format format) { return m_pThreadPool->Enqueue([path, format]() { return Texture::Decode(path, format); }); };
+		std::future<Texture*> vehicleDiffuse{ decode("Resources/vehicle_diffuse.png", Texture::Format::RGBA8) };
+		std::future<Texture*> vehicleNormal{ decode("Resources/vehicle_normal.png", Texture::Format::RGBA8) };
+		std::future<Texture*> vehicleSpecular{ decode("Resources/vehicle_specular.png", Texture::Format::RGBA8) };
+		std::future<Texture*> vehicleGlossiness{ decode("Resources/vehicle_gloss.png", Texture::Format::RGBA8) };
+		std::future<Texture*> fireDiffuse{ decode("Resources/fireFX_diffuse.png", Texture::Format::BC3) };
+		std::future<SplitSumLut*> splitSumLut{ m_pThreadPool->Enqueue([]() { return new SplitSumLut{ SplitSumLut::DefaultSize, SplitSumLut::DefaultNumSamples }; }) };
+
 		std::vector<Vertex> vehicleVertices{};
 		std::vector<uint32_t> vehicleIndices{};
 
 		std::vector<Vertex> fireVertices{};
 		std::vector<uint32_t> fireIndices{};
 
-		Utils::ParseOBJ("Resources/vehicle.obj", vehicleVertices, vehicleIndices);
-		Utils::ParseOBJ("Resources/fireFX.obj", fireVertices, fireIndices);
+		std::future<bool> fireParsed{ m_pThreadPool->Enqueue([&fireVertices, &fireIndices]() { return Utils::ParseOBJ("Resources/fireFX.obj", fireVertices, fireIndices); }) };
+		const bool isVehicleParsed{ Utils::ParseOBJ("Resources/vehicle.obj", vehicleVertices, vehicleIndices) };
+		const bool isFireParsed{ fireParsed.get() };
 
 
 		// Textures
-		m_pVehicleDiffuseTexture = Texture::LoadFromFile(m_pDevice, "Resources/vehicle_diffuse.png");
-		m_pVehicleNormalTexture = Texture::LoadFromFile(m_pDevice, "Resources/vehicle_normal.png");
-		m_pVehicleSpecularTexture = Texture::LoadFromFile(m_pDevice, "Resources/vehicle_specular.png");
-		m_pVehicleGlossinessTexture = Texture::LoadFromFile(m_pDevice, "Resources/vehicle_gloss.png");
+		//Only the material set is sampled on the CPU, it is registered as soon as it is built so its finer levels are paged out right away
+		const std::string pageFileName{ "DualRasterizer_TexturePages_" + std::to_string(GetCurrentProcessId()) + ".bin" };
+		m_pTextureResidency = new TextureResidency{ DefaultTextureBudget, (std::filesystem::temp_directory_path() / pageFileName).string() };
+
+		//The device isn't thread safe for us, so the D3D copies are all created here once the decodes are done
+		//The separate maps are only sampled by D3D, so their CPU copy goes as soon as the D3D one exists
+		const auto finalize = [this](Texture* pTexture, Texture::Format format)
+		{
+			if (!pTexture)
+				return pTexture;
+			pTexture->Compress(format);
+			if (!pTexture->Finalize(m_pDevice, Texture::Layout::Linear))
+			{
+				delete pTexture;
+				return static_cast<Texture*>(nullptr);
+			}
+			pTexture->ReleaseCpuCopy();
+			return pTexture;
+		};
+		Texture* pVehicleDiffuse{ vehicleDiffuse.get() };
+		Texture* pVehicleNormal{ vehicleNormal.get() };
+		Texture* pVehicleSpecular{ vehicleSpecular.get() };
+		Texture* pVehicleGlossiness{ vehicleGlossiness.get() };
+		if (pVehicleDiffuse && pVehicleNormal && pVehicleSpecular && pVehicleGlossiness)
+		{
+			m_pVehicleMaterial = new MaterialTextureSet{ pVehicleDiffuse, pVehicleNormal, pVehicleSpecular, pVehicleGlossiness,
+				Texture::Layout::Swizzled, true };
+			m_pTextureResidency->Register(m_pVehicleMaterial);
+		}
 
-		m_pFireDiffuseTexture = Texture::LoadFromFile(m_pDevice, "Resources/fireFX_diffuse.png");
+		m_pVehicleDiffuseTexture = finalize(pVehicleDiffuse, Texture::Format::BC1);
+		m_pVehicleNormalTexture = finalize(pVehicleNormal, Texture::Format::BC5);
+		m_pVehicleSpecularTexture = finalize(pVehicleSpecular, Texture::Format::BC1);
+		m_pVehicleGlossinessTexture = finalize(pVehicleGlossiness, Texture::Format::BC1);
+
+		m_pFireDiffuseTexture = finalize(fireDiffuse.get(), Texture::Format::BC3);
+		m_pSplitSumLut = splitSumLut.get();
+
+		//Whatever did load is freed by the destructor, the effects and meshes below would dereference what didn't
+		const auto isLoaded = [](bool isResourceLoaded, const char* path)
+		{
+			if (!isResourceLoaded)
+				std::cout << "Failed to load " << path << "\n";
+			return isResourceLoaded;
+		};
+		bool isEverythingLoaded{ isLoaded(isVehicleParsed, "Resources/vehicle.obj") };
+		isEverythingLoaded &= isLoaded(isFireParsed, "Resources/fireFX.obj");
+		isEverythingLoaded &= isLoaded(m_pVehicleDiffuseTexture, "Resources/vehicle_diffuse.png");
+		isEverythingLoaded &= isLoaded(m_pVehicleNormalTexture, "Resources/vehicle_normal.png");
+		isEverythingLoaded &= isLoaded(m_pVehicleSpecularTexture, "Resources/vehicle_specular.png");
+		isEverythingLoaded &= isLoaded(m_pVehicleGlossinessTexture, "Resources/vehicle_gloss.png");
+		isEverythingLoaded &= isLoaded(m_pFireDiffuseTexture, "Resources/fireFX_diffuse.png");
+		if (!isEverythingLoaded)
+		{
+			std::cout << "Resource loading failed, nothing will be rendered\n";
+			m_IsInitialized = false;
+			return;
+		}
+
+		std::cout << "CPU texture memory: " << m_pTextureResidency->GetResidentSize() / 1024 << " KB, budget " << m_pTextureResidency->GetBudget() / 1024 << " KB\n";
+		std::cout << "Resources loaded in " << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count() << " ms\n";
 
 		// Effects
 		m_pVehicleEffect = new VehicleEffect{ m_pDevice,L"Resources/VehicleShader.fx" };
@@ -75,6 +175,28 @@ namespace dae {
 		m_pMeshes.emplace_back(m_pVehicleMesh);
 		m_pMeshes.emplace_back(m_pFireMesh);
 
+		m_pSoftwareMeshes.emplace_back(m_pVehicleMesh);
+
+		//Exactly one frame of post-transform data, plus the alignment padding of every allocation
+		size_t frameArenaSize{};
+		for (Mesh* pMesh : m_pSoftwareMeshes)
+		{
+			frameArenaSize += TransformedMesh::NumStreams * (pMesh->GetVertexStreams().positionX.size() * sizeof(float) + alignof(float));
+		}
+		m_pFrameArena = new FrameArena{ frameArenaSize };
+		m_TransformedMeshes.resize(m_pSoftwareMeshes.size());
+
+		for (uint32_t meshIdx{}; meshIdx < uint32_t(m_pSoftwareMeshes.size()); ++meshIdx)
+		{
+			m_FirstVertexChunks.emplace_back(uint32_t(m_VertexChunks.size()));
+
+			const size_t paddedSize{ m_pSoftwareMeshes[meshIdx]->GetVertexStreams().positionX.size() };
+			for (size_t begin{}; begin < paddedSize; begin += VertexChunkSize)
+			{
+				m_VertexChunks.emplace_back(VertexChunk{ meshIdx, begin, std::min(begin + VertexChunkSize, paddedSize) });
+			}
+		}
+		m_IsVertexChunkDone = std::vector<std::atomic<bool>>(m_VertexChunks.size());
 
 
 	}
@@ -87,6 +209,8 @@ namespace dae {
 
 	void Renderer::Update(const Timer* pTimer)
 	{
+		if (!m_IsInitialized)
+			return;
 		m_pCamera->Update(pTimer);
 		Matrix WVPMatrix = m_pVehicleMesh->GetWorldMatrix() * m_pCamera->GetViewMatrix() * m_pCamera->GetProjectionMatrix();
 		m_pVehicleMesh->Update(pTimer, WVPMatrix, m_pCamera->GetInvViewMatrix(), m_RotateMeshes);
@@ -112,6 +236,7 @@ namespace dae {
 		m_pDeviceContext->ClearRenderTargetView(m_pRenderTargetView, &clearColor.r);
 		m_pDeviceContext->ClearDepthStencilView(m_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.f, 0);
 
+		m_pVehicleEffect->SetLights(m_Lights);
 		for (const auto& mesh : m_pMeshes)
 		{
 			mesh->Render(m_pDeviceContext);
@@ -123,214 +248,1287 @@ namespace dae {
 
 	void Renderer::RenderSoftware() const
 	{
+		if (!m_IsInitialized)
+			return;
 		ClearBackground();
 		//@START
 		//Lock BackBuffer
 		SDL_LockSurface(m_pBackBuffer);
 		//fill depthbuffer with max float value each frame
 		std::fill_n(m_pDepthBufferPixels, m_Width * m_Height, FLT_MAX);
+		ClearHiZ();
+		if (m_UseDeferredShading)
+		{
+			std::fill_n(m_pVisibilityBufferPixels, m_Width * m_Height, 0u);
+		}
 		SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format, Uint8(m_BGColor.r * 255), Uint8(m_BGColor.g * 255), Uint8(m_BGColor.b * 255)));
 
 
-		VertexTransformationFunction(m_pMeshes);
-		//convert NDC to Raster/Screen Space
-		std::vector<Vector2> rasterVertices{};
-		ConvertToRaster(m_pMeshes, rasterVertices);
+		//Everything the previous frame put in the arena is dead by now
+		m_pFrameArena->Reset();
+		//The modes only change between frames
+		m_pPixelShader = SelectPixelShader();
+		//The levels the previous frame sampled are read in before anything samples again
+		m_pTextureResidency->Update();
+		BinLights();
+		//Decided before the transform, which also projects the vertices into the shadow map
+		const bool hasShadowMap{ PrepareShadowMap(m_pSoftwareMeshes) };
+
+		PrepareTransformedMeshes(m_pSoftwareMeshes);
+
+		//The workers transform the vertex chunks (also converts NDC to Raster/Screen Space) while this thread sets up the triangles of finished ones
+		const std::function<void(uint32_t)> transformChunk{ [this](uint32_t chunkIdx) { TransformVertexChunk(chunkIdx); } };
+		ThreadPool::Batch vertexBatch{};
+		m_pThreadPool->Start(vertexBatch, uint32_t(m_VertexChunks.size()), transformChunk);
+		SetupTriangles(m_pSoftwareMeshes, vertexBatch);
+		m_pThreadPool->Wait(vertexBatch);
+
+		//Every pixel shader may sample it, so it's complete before the first tile starts
+		if (hasShadowMap)
+		{
+			RenderShadowMap(m_pSoftwareMeshes);
+		}
+
+		if (m_UseTiledRendering)
+		{
+			RenderTiles();
+		}
+		else
+		{
+			for (uint32_t triangleIdx{}; triangleIdx < uint32_t(m_RasterTriangles.size()); ++triangleIdx)
+			{
+				RasterizeTriangle(triangleIdx, 0, 0, m_Width, m_Height);
+			}
+
+			if (m_UseDeferredShading)
+			{
+				ShadeVisibilityBuffer(0, 0, m_Width, m_Height);
+			}
+			FlushPhysicallyBasedBatch();
+		}
+
+		//@END
+		//Update SDL Surface
+		SDL_UnlockSurface(m_pBackBuffer);
+		SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
+		SDL_UpdateWindowSurface(m_pWindow);
+	}
+
+	void Renderer::SetupTriangles(const std::vector<Mesh*>& meshes, ThreadPool::Batch& vertexBatch) const
+	{
+		m_RasterTriangles.clear();
+
+		const Vector3 camViewVec{ -m_pCamera->GetInvViewMatrix().GetAxisZ() };
+
+		for (size_t meshIdx{}; meshIdx < meshes.size(); ++meshIdx)
+		{
+			Mesh* pMesh{ meshes[meshIdx] };
+			const std::vector<uint32_t>& indices{ pMesh->GetIndices() };
+			const VertexStreams& input{ pMesh->GetVertexStreams() };
+			const TransformedMesh& transformed{ m_TransformedMeshes[meshIdx] };
+
+			//Vertices [0, numReadyVertices) are transformed, the chunks finish roughly in order so this rarely has to wait
+			size_t numReadyVertices{};
+			uint32_t nextChunkIdx{ m_FirstVertexChunks[meshIdx] };
+
+			//loop over each defined triangle
+			for (size_t i{}; i < indices.size(); i += 3)
+			{
+				//indices of the triangle 
+				const uint32_t v0Idx{ indices[i] };
+				const uint32_t v1Idx{ indices[i + 1] };
+				const uint32_t v2Idx{ indices[i + 2] };
+
+				while (std::max({ v0Idx, v1Idx, v2Idx }) >= numReadyVertices)
+				{
+					WaitForVertexChunk(vertexBatch, nextChunkIdx);
+					numReadyVertices = m_VertexChunks[nextChunkIdx].end;
+					++nextChunkIdx;
+				}
+
+				//dont render degenerate triangles
+				if (v0Idx == v1Idx || v1Idx == v2Idx || v0Idx == v2Idx)
+					continue;
+
+				//Vertices
+				const Vertex_Out worldV0{ GatherVertex(input, transformed, v0Idx) };
+				const Vertex_Out worldV1{ GatherVertex(input, transformed, v1Idx) };
+				const Vertex_Out worldV2{ GatherVertex(input, transformed, v2Idx) };
+				const Vector2 raster0{ transformed.pRasterX[v0Idx], transformed.pRasterY[v0Idx] };
+				const Vector2 raster1{ transformed.pRasterX[v1Idx], transformed.pRasterY[v1Idx] };
+				const Vector2 raster2{ transformed.pRasterX[v2Idx], transformed.pRasterY[v2Idx] };
+
+				//Outcodes against the viewport reject triangles that are completely off screen
+				const Vector4 clip0{ ToClipSpace(worldV0.position) };
+				const Vector4 clip1{ ToClipSpace(worldV1.position) };
+				const Vector4 clip2{ ToClipSpace(worldV2.position) };
+				if ((GetOutcode(clip0, 1.f) & GetOutcode(clip1, 1.f) & GetOutcode(clip2, 1.f)) != 0)
+				{
+					continue;
+				}
+
+				if (pMesh->GetCullMode() != Mesh::CullMode::None)
+				{
+					//Calculate average triangle normal from the vertex normals we get from parsing the OBJ
+					Vector3 avgNormal{ (worldV0.normal + worldV1.normal + worldV2.normal) / 3.0f };
+					avgNormal = avgNormal.Normalized();
+
+					float dotProduct{ Vector3::Dot(avgNormal,camViewVec) };
+
+					if (pMesh->GetCullMode() == Mesh::CullMode::Back)
+					{
+						if (dotProduct < 0)
+							continue;
+					}
+					else if (pMesh->GetCullMode() == Mesh::CullMode::Front)
+					{
+						if (dotProduct > 0)
+							continue;
+					}
+				}
+
+				//Outcodes against the guard band tell which planes actually need clipping
+				const int planeMask{ GetOutcode(clip0, GuardBand) | GetOutcode(clip1, GuardBand) | GetOutcode(clip2, GuardBand) };
+				if (planeMask != 0)
+				{
+					ClipTriangle(worldV0, worldV1, worldV2, raster0, raster1, raster2, planeMask);
+					continue;
+				}
+
+				AddRasterTriangle(worldV0, worldV1, worldV2, raster0, raster1, raster2);
+			}
+		}
+	}
+
+	void Renderer::AddRasterTriangle(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2, const Vector2& raster0, const Vector2& raster1, const Vector2& raster2) const
+	{
+		RasterTriangle triangle{ v0, v1, v2 };
+
+		//Screen-space vertex coordinates, snapped to the fixed point grid so shared edges are identical for both triangles
+		const auto toFixed = [](const Vector2& raster) -> Int2
+			{
+				return { int(std::lround(raster.x * SubPixelScale)), int(std::lround(raster.y * SubPixelScale)) };
+			};
+		triangle.fixed0 = toFixed(raster0);
+		triangle.fixed1 = toFixed(raster1);
+		triangle.fixed2 = toFixed(raster2);
+
+		//Back-facing and zero-area triangles never cover a pixel
+		triangle.doubleArea =
+			(int64_t(triangle.fixed1.x) - triangle.fixed0.x) * (int64_t(triangle.fixed2.y) - triangle.fixed1.y) -
+			(int64_t(triangle.fixed1.y) - triangle.fixed0.y) * (int64_t(triangle.fixed2.x) - triangle.fixed1.x);
+		if (triangle.doubleArea <= 0)
+			return;
+
+		CreateBoundingBox(triangle);
+
+		//Weights sum to 0.5, which makes the interpolated depth twice the NDC depth, and it never gets below the closest vertex
+		//The small margin keeps float rounding in the interpolation from producing a value under the bound
+		triangle.minDepth = 2.f * std::min({ v0.position.z, v1.position.z, v2.position.z }) * (1.f - 1e-6f);
+
+		//The weights are the edge functions times weightScale, so their per pixel steps follow from the edge steps
+		const float weightScale{ 0.5f / float(triangle.doubleArea) };
+		const float weightDx[3]
+		{
+			float(triangle.fixed1.y - triangle.fixed2.y) * SubPixelScale * weightScale,
+			float(triangle.fixed2.y - triangle.fixed0.y) * SubPixelScale * weightScale,
+			float(triangle.fixed0.y - triangle.fixed1.y) * SubPixelScale * weightScale
+		};
+		const float weightDy[3]
+		{
+			float(triangle.fixed2.x - triangle.fixed1.x) * SubPixelScale * weightScale,
+			float(triangle.fixed0.x - triangle.fixed2.x) * SubPixelScale * weightScale,
+			float(triangle.fixed1.x - triangle.fixed0.x) * SubPixelScale * weightScale
+		};
+		const Vertex_Out* vertices[3]{ &v0, &v1, &v2 };
+		for (int i{}; i < 3; ++i)
+		{
+			const float invW{ 1.f / vertices[i]->position.w };
+			triangle.uvOverWDx += vertices[i]->uv * (weightDx[i] * invW);
+			triangle.uvOverWDy += vertices[i]->uv * (weightDy[i] * invW);
+			triangle.invWDx += weightDx[i] * invW;
+			triangle.invWDy += weightDy[i] * invW;
+		}
+
+		m_RasterTriangles.emplace_back(triangle);
+	}
+
+	void Renderer::BinTriangles() const
+	{
+		for (std::vector<uint32_t>& bin : m_TileBins)
+		{
+			bin.clear();
+		}
+
+		//Triangles are appended in submission order, so every tile sees its triangles in the same order as the single-threaded path
+		for (uint32_t triangleIdx{}; triangleIdx < uint32_t(m_RasterTriangles.size()); ++triangleIdx)
+		{
+			const RasterTriangle& triangle{ m_RasterTriangles[triangleIdx] };
+			if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
+				continue;
+
+			const int firstTileX{ triangle.minX / TileSize };
+			const int firstTileY{ triangle.minY / TileSize };
+			const int lastTileX{ (triangle.maxX - 1) / TileSize };
+			const int lastTileY{ (triangle.maxY - 1) / TileSize };
+
+			for (int tileY{ firstTileY }; tileY <= lastTileY; ++tileY)
+			{
+				for (int tileX{ firstTileX }; tileX <= lastTileX; ++tileX)
+				{
+					m_TileBins[tileY * m_NumTilesX + tileX].emplace_back(triangleIdx);
+				}
+			}
+		}
+	}
+
+	void Renderer::BinLights() const
+	{
+		for (std::vector<uint32_t>& tileLights : m_TileLights)
+		{
+			tileLights.clear();
+		}
+
+		const Matrix viewProjection{ m_pCamera->GetViewMatrix() * m_pCamera->GetProjectionMatrix() };
+		for (uint32_t lightIdx{}; lightIdx < uint32_t(m_Lights.size()); ++lightIdx)
+		{
+			//Directional lights reach every tile
+			int firstTileX{};
+			int firstTileY{};
+			int lastTileX{ m_NumTilesX - 1 };
+			int lastTileY{ m_NumTilesY - 1 };
+			const Light& light{ m_Lights[lightIdx] };
+			if (light.type != Light::Type::Directional && !FindLightTiles(light, viewProjection, firstTileX, firstTileY, lastTileX, lastTileY))
+				continue;
+
+			for (int tileY{ firstTileY }; tileY <= lastTileY; ++tileY)
+			{
+				for (int tileX{ firstTileX }; tileX <= lastTileX; ++tileX)
+				{
+					m_TileLights[tileY * m_NumTilesX + tileX].emplace_back(lightIdx);
+				}
+			}
+		}
+	}
+
+	bool Renderer::FindLightTiles(const Light& light, const Matrix& viewProjection, int& firstTileX, int& firstTileY, int& lastTileX, int& lastTileY) const
+	{
+		//Bounds of the box around the range sphere, a little larger than the sphere's own but a lot simpler to project
+		int outcode{ ~0 };
+		bool isCrossingCameraPlane{ false };
+		Vector2 rasterMin{ FLT_MAX, FLT_MAX };
+		Vector2 rasterMax{ -FLT_MAX, -FLT_MAX };
+		for (int corner{}; corner < 8; ++corner)
+		{
+			const Vector3 offset{ corner & 1 ? light.range : -light.range, corner & 2 ? light.range : -light.range, corner & 4 ? light.range : -light.range };
+			const Vector4 clipPosition{ viewProjection.TransformPoint(Vector4{ light.position + offset, 1.f }) };
+			outcode &= GetOutcode(clipPosition, 1.f);
+
+			//A corner behind the camera projects to the wrong side of the screen
+			if (clipPosition.w <= 0.f)
+			{
+				isCrossingCameraPlane = true;
+				continue;
+			}
+			const Vector2 raster{ NdcToRaster({ clipPosition.x / clipPosition.w, clipPosition.y / clipPosition.w, 0.f, 0.f }) };
+			rasterMin = { std::min(rasterMin.x, raster.x), std::min(rasterMin.y, raster.y) };
+			rasterMax = { std::max(rasterMax.x, raster.x), std::max(rasterMax.y, raster.y) };
+		}
+
+		//All corners outside the same plane, so the whole box is
+		if (outcode != 0)
+			return false;
+		//Already set to the whole screen
+		if (isCrossingCameraPlane)
+			return true;
+
+		firstTileX = int(std::clamp(rasterMin.x, 0.f, float(m_Width - 1))) / TileSize;
+		firstTileY = int(std::clamp(rasterMin.y, 0.f, float(m_Height - 1))) / TileSize;
+		lastTileX = int(std::clamp(rasterMax.x, 0.f, float(m_Width - 1))) / TileSize;
+		lastTileY = int(std::clamp(rasterMax.y, 0.f, float(m_Height - 1))) / TileSize;
+		return true;
+	}
+
+	const std::vector<uint32_t>& Renderer::GetTileLights(int pixelIdx) const
+	{
+		const int px{ pixelIdx % m_Width };
+		const int py{ pixelIdx / m_Width };
+		return m_TileLights[py / TileSize * m_NumTilesX + px / TileSize];
+	}
+
+	std::vector<uint32_t> Renderer::GetTileLightCounts() const
+	{
+		std::vector<uint32_t> counts{};
+		counts.reserve(m_TileLights.size());
+		for (const std::vector<uint32_t>& tileLights : m_TileLights)
+		{
+			counts.emplace_back(uint32_t(tileLights.size()));
+		}
+		return counts;
+	}
+
+	void Renderer::RenderTiles() const
+	{
+		BinTriangles();
+
+		//A tile only ever writes the depth and color pixels inside its own rectangle, so tiles need no locking
+		m_pThreadPool->ParallelFor(uint32_t(m_TileBins.size()), [this](uint32_t tileIdx)
+			{
+				const int tileMinX{ int(tileIdx) % m_NumTilesX * TileSize };
+				const int tileMinY{ int(tileIdx) / m_NumTilesX * TileSize };
+				const int tileMaxX{ std::min(tileMinX + TileSize, m_Width) };
+				const int tileMaxY{ std::min(tileMinY + TileSize, m_Height) };
+
+				for (const uint32_t triangleIdx : m_TileBins[tileIdx])
+				{
+					RasterizeTriangle(triangleIdx, tileMinX, tileMinY, tileMaxX, tileMaxY);
+				}
+
+				//The tile's visibility is final once all its triangles are in, shade it while it is still in cache
+				if (m_UseDeferredShading)
+				{
+					ShadeVisibilityBuffer(tileMinX, tileMinY, tileMaxX, tileMaxY);
+				}
+				//The next tile on this thread can be anywhere, the batched pixels of this one are finished first
+				FlushPhysicallyBasedBatch();
+			});
+	}
+
+	void Renderer::RasterizeTriangle(uint32_t triangleIdx, int clipMinX, int clipMinY, int clipMaxX, int clipMaxY) const
+	{
+		const RasterTriangle& triangle{ m_RasterTriangles[triangleIdx] };
+
+		const int minX{ std::max(triangle.minX, clipMinX) };
+		const int minY{ std::max(triangle.minY, clipMinY) };
+		const int maxX{ std::min(triangle.maxX, clipMaxX) };
+		const int maxY{ std::min(triangle.maxY, clipMaxY) };
+
+		if (m_UseBBVis)
+		{
+			const uint32_t red{ SDL_MapRGB(m_pBackBuffer->format, 255, 0, 0) };
+			for (int py{ minY }; py < maxY; ++py)
+			{
+				std::fill(m_pBackBufferPixels + py * m_Width + minX, m_pBackBufferPixels + py * m_Width + maxX, red);
+			}
+			return;
+		}
+
+		if (IsOccluded(triangle.minDepth, minX, minY, maxX, maxY))
+			return;
+
+		//Edges in screen-space
+		const EdgeFunction edge01{ SetupEdge(triangle.fixed0, triangle.fixed1) };
+		const EdgeFunction edge12{ SetupEdge(triangle.fixed1, triangle.fixed2) };
+		const EdgeFunction edge20{ SetupEdge(triangle.fixed2, triangle.fixed0) };
+
+		//The SIMD kernels step the edges in 32 bit lanes, huge triangles keep using 64 bit math
+		const bool fitsInt32Lanes
+		{
+			FitsInt32Lanes(edge01, minX, minY, maxX, maxY) &&
+			FitsInt32Lanes(edge12, minX, minY, maxX, maxY) &&
+			FitsInt32Lanes(edge20, minX, minY, maxX, maxY)
+		};
+
+		switch (fitsInt32Lanes ? m_SimdLevel : Simd::Level::Scalar)
+		{
+		case Simd::Level::AVX2:
+			RasterizeTriangleSimd<Simd::Float8>(triangleIdx, edge01, edge12, edge20, minX, minY, maxX, maxY);
+			break;
+		case Simd::Level::SSE2:
+			RasterizeTriangleSimd<Simd::Float4>(triangleIdx, edge01, edge12, edge20, minX, minY, maxX, maxY);
+			break;
+		default:
+			RasterizeTriangleScalar(triangleIdx, edge01, edge12, edge20, minX, minY, maxX, maxY);
+			break;
+		}
+
+		UpdateHiZ(minX, minY, maxX, maxY);
+	}
+
+	void Renderer::RasterizeTriangleScalar(uint32_t triangleIdx, const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20,
+		int minX, int minY, int maxX, int maxY) const
+	{
+		const RasterTriangle& triangle{ m_RasterTriangles[triangleIdx] };
+
+		//Weights are (edge / 2) / area like before, the fixed point scale cancels out
+		const float weightScale{ 0.5f / float(triangle.doubleArea) };
+
+		//RENDER LOGIC
+		for (int py{ minY }; py < maxY; ++py)
+		{
+			//The span is exact, every pixel in it is covered so there is no per-pixel edge test
+			int startX{ minX };
+			int endX{ maxX };
+			if (!FindSpan(edge01, edge12, edge20, py, startX, endX))
+				continue;
+
+			assert(IsCovered(triangle, startX, py) && IsCovered(triangle, endX - 1, py));
+			assert(startX == minX || !IsCovered(triangle, startX - 1, py));
+			assert(endX == maxX || !IsCovered(triangle, endX, py));
+
+			//Walk the span in pieces that stay inside one 8x8 block, pieces in blocks that are already closer are skipped
+			int segmentEnd{};
+			for (int segmentStart{ startX }; segmentStart < endX; segmentStart = segmentEnd)
+			{
+				if (!NextHiZSegment(triangle.minDepth, py, segmentStart, endX, segmentEnd))
+					continue;
+
+				//Integer stepping has no drift, so a pixel gets the same values no matter which tile started the span
+				int64_t edge01Check{ edge01.RowValue(py) + edge01.stepX * segmentStart };
+				int64_t edge12Check{ edge12.RowValue(py) + edge12.stepX * segmentStart };
+				int64_t edge20Check{ edge20.RowValue(py) + edge20.stepX * segmentStart };
+				for (int px{ segmentStart }; px < segmentEnd; ++px)
+				{
+					//Weights
+					const float weightV2{ float(edge01Check) * weightScale };
+					const float weightV0{ float(edge12Check) * weightScale };
+					const float weightV1{ float(edge20Check) * weightScale };
+
+					if (m_UseDeferredShading)
+						WriteVisibility(triangleIdx, weightV0, weightV1, weightV2, py * m_Width + px);
+					else
+						ShadeFragment(triangle, weightV0, weightV1, weightV2, py * m_Width + px);
+
+					edge01Check += edge01.stepX;
+					edge12Check += edge12.stepX;
+					edge20Check += edge20.stepX;
+				}
+			}
+		}
+	}
+
+	Renderer::EdgeFunction Renderer::SetupEdge(const Int2& from, const Int2& to)
+	{
+		const int64_t edgeX{ int64_t(to.x) - from.x };
+		const int64_t edgeY{ int64_t(to.y) - from.y };
+
+		//E(P) = Cross(edge, P - from) with P the pixel center (px + 0.5, py + 0.5) in fixed point
+		EdgeFunction edge{};
+		edge.stepX = -edgeY * SubPixelScale;
+		edge.stepY = edgeX * SubPixelScale;
+		edge.origin = edgeX * (SubPixelScale / 2 - from.y) - edgeY * (SubPixelScale / 2 - from.x);
+
+		//Drawn triangles wind clockwise on screen (y down): left edges go up, top edges are horizontal and go right
+		const bool isTopLeft{ edgeY < 0 || (edgeY == 0 && edgeX > 0) };
+		edge.bias = isTopLeft ? 1 : 0;
+		return edge;
+	}
+
+	bool Renderer::FitsInt32Lanes(const EdgeFunction& edge, int minX, int minY, int maxX, int maxY)
+	{
+		//E is affine, so its extremes over the box are at the corners; the box is widened by a block for the lanes past the span end
+		constexpr int64_t limit{ int64_t(1) << 30 };
+		const int cornersX[2]{ minX, maxX + 8 };
+		const int cornersY[2]{ minY, maxY };
+		for (const int py : cornersY)
+		{
+			for (const int px : cornersX)
+			{
+				const int64_t value{ edge.RowValue(py) + edge.stepX * px };
+				if (value >= limit || value <= -limit)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	bool Renderer::FindSpan(const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20, int py, int& spanStart, int& spanEnd)
+	{
+		int64_t start{ spanStart };
+		int64_t end{ spanEnd };
+		if (!NarrowSpan(edge01.RowValue(py) + edge01.bias, edge01.stepX, start, end) ||
+			!NarrowSpan(edge12.RowValue(py) + edge12.bias, edge12.stepX, start, end) ||
+			!NarrowSpan(edge20.RowValue(py) + edge20.bias, edge20.stepX, start, end))
+		{
+			return false;
+		}
+
+		spanStart = int(start);
+		spanEnd = int(end);
+		return true;
+	}
+
+	bool Renderer::NarrowSpan(int64_t rowValue, int64_t step, int64_t& spanStart, int64_t& spanEnd)
+	{
+		//Solve rowValue + step * px > 0 for px, with floor/ceil divisions that are exact for negative numbers too
+		const auto floorDiv = [](int64_t a, int64_t b) { return a / b - ((a % b != 0) && ((a < 0) != (b < 0)) ? 1 : 0); };
+
+		if (step > 0)
+			spanStart = std::max(spanStart, floorDiv(-rowValue, step) + 1);
+		else if (step < 0)
+			spanEnd = std::min(spanEnd, -floorDiv(-rowValue, -step));
+		else
+			return rowValue > 0;
+
+		return spanStart < spanEnd;
+	}
+
+	bool Renderer::IsCovered(const RasterTriangle& triangle, int px, int py)
+	{
+		//Reference coverage test, evaluates the edges from scratch to check the spans
+		const int64_t sampleX{ int64_t(px) * SubPixelScale + SubPixelScale / 2 };
+		const int64_t sampleY{ int64_t(py) * SubPixelScale + SubPixelScale / 2 };
+
+		const Int2* vertices[3]{ &triangle.fixed0, &triangle.fixed1, &triangle.fixed2 };
+		for (int i{}; i < 3; ++i)
+		{
+			const Int2& from{ *vertices[i] };
+			const Int2& to{ *vertices[(i + 1) % 3] };
+			const int64_t edgeX{ int64_t(to.x) - from.x };
+			const int64_t edgeY{ int64_t(to.y) - from.y };
+
+			const int64_t value{ edgeX * (sampleY - from.y) - edgeY * (sampleX - from.x) };
+			const bool isTopLeft{ edgeY < 0 || (edgeY == 0 && edgeX > 0) };
+			if (value < 0 || (value == 0 && !isTopLeft))
+				return false;
+		}
+		return true;
+	}
+
+	void Renderer::ClearHiZ() const
+	{
+		std::fill(m_HiZBlocks.begin(), m_HiZBlocks.end(), FLT_MAX);
+		std::fill(m_HiZTiles.begin(), m_HiZTiles.end(), FLT_MAX);
+		std::fill(m_HiZDirty.begin(), m_HiZDirty.end(), uint8_t(0));
+	}
+
+	bool Renderer::IsOccluded(float minDepth, int minX, int minY, int maxX, int maxY) const
+	{
+		//In tiled mode the rectangle is clipped to one tile, so this is a single compare
+		for (int tileY{ minY / TileSize }; tileY <= (maxY - 1) / TileSize; ++tileY)
+		{
+			for (int tileX{ minX / TileSize }; tileX <= (maxX - 1) / TileSize; ++tileX)
+			{
+				if (minDepth < m_HiZTiles[tileY * m_NumTilesX + tileX])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	bool Renderer::NextHiZSegment(float minDepth, int py, int segmentStart, int spanEnd, int& segmentEnd) const
+	{
+		const int blockX{ segmentStart / HiZBlockSize };
+		const int blockIdx{ py / HiZBlockSize * m_NumHiZBlocksX + blockX };
+		segmentEnd = std::min(spanEnd, (blockX + 1) * HiZBlockSize);
+
+		if (minDepth >= m_HiZBlocks[blockIdx])
+			return false;
+
+		m_HiZDirty[blockIdx] = 1;
+		return true;
+	}
+
+	void Renderer::UpdateHiZ(int minX, int minY, int maxX, int maxY) const
+	{
+		if (minX >= maxX || minY >= maxY)
+			return;
+
+		const int firstBlockX{ minX / HiZBlockSize };
+		const int firstBlockY{ minY / HiZBlockSize };
+		const int lastBlockX{ (maxX - 1) / HiZBlockSize };
+		const int lastBlockY{ (maxY - 1) / HiZBlockSize };
+
+		bool hasChanged{ false };
+		for (int blockY{ firstBlockY }; blockY <= lastBlockY; ++blockY)
+		{
+			for (int blockX{ firstBlockX }; blockX <= lastBlockX; ++blockX)
+			{
+				const int blockIdx{ blockY * m_NumHiZBlocksX + blockX };
+				if (!m_HiZDirty[blockIdx])
+					continue;
+				m_HiZDirty[blockIdx] = 0;
+
+				//Depth writes only ever lower values, so the block max has to be rebuilt from its pixels
+				const int pixelMinX{ blockX * HiZBlockSize };
+				const int pixelMaxX{ std::min(pixelMinX + HiZBlockSize, m_Width) };
+				const int pixelMaxY{ std::min((blockY + 1) * HiZBlockSize, m_Height) };
+				float maxDepth{};
+				for (int py{ blockY * HiZBlockSize }; py < pixelMaxY; ++py)
+				{
+					const float* pRow{ m_pDepthBufferPixels + py * m_Width };
+					maxDepth = std::max(maxDepth, *std::max_element(pRow + pixelMinX, pRow + pixelMaxX));
+				}
+				m_HiZBlocks[blockIdx] = maxDepth;
+				hasChanged = true;
+			}
+		}
+
+		if (!hasChanged)
+			return;
+
+		constexpr int blocksPerTile{ TileSize / HiZBlockSize };
+		for (int tileY{ minY / TileSize }; tileY <= (maxY - 1) / TileSize; ++tileY)
+		{
+			for (int tileX{ minX / TileSize }; tileX <= (maxX - 1) / TileSize; ++tileX)
+			{
+				const int tileBlockMaxX{ std::min((tileX + 1) * blocksPerTile, m_NumHiZBlocksX) };
+				const int tileBlockMaxY{ std::min((tileY + 1) * blocksPerTile, m_NumHiZBlocksY) };
+				float maxDepth{};
+				for (int blockY{ tileY * blocksPerTile }; blockY < tileBlockMaxY; ++blockY)
+				{
+					const auto rowBegin{ m_HiZBlocks.begin() + blockY * m_NumHiZBlocksX };
+					maxDepth = std::max(maxDepth, *std::max_element(rowBegin + tileX * blocksPerTile, rowBegin + tileBlockMaxX));
+				}
+				m_HiZTiles[tileY * m_NumTilesX + tileX] = maxDepth;
+			}
+		}
+	}
+
+	template<typename SimdFloat>
+	void Renderer::RasterizeTriangleSimd(uint32_t triangleIdx, const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20,
+		int minX, int minY, int maxX, int maxY) const
+	{
+		using Float = typename SimdFloat::Float;
+		using Int = typename SimdFloat::Int;
+
+		const RasterTriangle& triangle{ m_RasterTriangles[triangleIdx] };
+
+		const Vertex_Out& worldV0{ triangle.v0 };
+		const Vertex_Out& worldV1{ triangle.v1 };
+		const Vertex_Out& worldV2{ triangle.v2 };
+
+		//Same weights as the scalar path: (edge / 2) / area
+		const Float weightScale{ SimdFloat::Set1(0.5f / float(triangle.doubleArea)) };
+
+		//Everything that only depends on the vertices is divided by z or w once per triangle instead of per pixel
+		const Float invZ0{ SimdFloat::Set1(1.f / worldV0.position.z) };
+		const Float invZ1{ SimdFloat::Set1(1.f / worldV1.position.z) };
+		const Float invZ2{ SimdFloat::Set1(1.f / worldV2.position.z) };
+		const Float invW0{ SimdFloat::Set1(1.f / worldV0.position.w) };
+		const Float invW1{ SimdFloat::Set1(1.f / worldV1.position.w) };
+		const Float invW2{ SimdFloat::Set1(1.f / worldV2.position.w) };
+
+		//uv, normal, tangent and world position, each pre-divided by w
+		constexpr int numAttributes{ 11 };
+		const auto packAttributes = [](const Vertex_Out& v, Float* pAttributes)
+			{
+				const float invW{ 1.f / v.position.w };
+				const float values[numAttributes]
+				{
+					v.uv.x, v.uv.y,
+					v.normal.x, v.normal.y, v.normal.z,
+					v.tangent.x, v.tangent.y, v.tangent.z,
+					v.worldPosition.x, v.worldPosition.y, v.worldPosition.z
+				};
+				for (int i{}; i < numAttributes; ++i)
+					pAttributes[i] = SimdFloat::Set1(values[i] * invW);
+			};
+		Float attributes0[numAttributes];
+		Float attributes1[numAttributes];
+		Float attributes2[numAttributes];
+		packAttributes(worldV0, attributes0);
+		packAttributes(worldV1, attributes1);
+		packAttributes(worldV2, attributes2);
+
+		//uv / w and 1 / w gradients for the uv derivatives, ordered as du/dx, dv/dx, du/dy, dv/dy
+		constexpr int numDerivatives{ 4 };
+		const Float uvOverWGradients[numDerivatives]
+		{
+			SimdFloat::Set1(triangle.uvOverWDx.x), SimdFloat::Set1(triangle.uvOverWDx.y),
+			SimdFloat::Set1(triangle.uvOverWDy.x), SimdFloat::Set1(triangle.uvOverWDy.y)
+		};
+		const Float invWGradients[numDerivatives]
+		{
+			SimdFloat::Set1(triangle.invWDx), SimdFloat::Set1(triangle.invWDx),
+			SimdFloat::Set1(triangle.invWDy), SimdFloat::Set1(triangle.invWDy)
+		};
+
+		const Float one{ SimdFloat::Set1(1.f) };
+
+		//Edge values of the lanes relative to the first lane, and how far a whole block moves them
+		const Int laneSteps01{ SimdFloat::LaneMultiples(int(edge01.stepX)) };
+		const Int laneSteps12{ SimdFloat::LaneMultiples(int(edge12.stepX)) };
+		const Int laneSteps20{ SimdFloat::LaneMultiples(int(edge20.stepX)) };
+		const Int blockStep01{ SimdFloat::Set1Int(int(edge01.stepX) * SimdFloat::Width) };
+		const Int blockStep12{ SimdFloat::Set1Int(int(edge12.stepX) * SimdFloat::Width) };
+		const Int blockStep20{ SimdFloat::Set1Int(int(edge20.stepX) * SimdFloat::Width) };
+
+		alignas(32) float laneZ[SimdFloat::Width];
+		alignas(32) float laneAttributes[numAttributes][SimdFloat::Width];
+		alignas(32) float laneDerivatives[numDerivatives][SimdFloat::Width];
+
+		for (int py{ minY }; py < maxY; ++py)
+		{
+			int startX{ minX };
+			int endX{ maxX };
+			if (!FindSpan(edge01, edge12, edge20, py, startX, endX))
+				continue;
+
+			assert(IsCovered(triangle, startX, py) && IsCovered(triangle, endX - 1, py));
+			assert(startX == minX || !IsCovered(triangle, startX - 1, py));
+			assert(endX == maxX || !IsCovered(triangle, endX, py));
+
+			int segmentEnd{};
+			for (int segmentStart{ startX }; segmentStart < endX; segmentStart = segmentEnd)
+			{
+				if (!NextHiZSegment(triangle.minDepth, py, segmentStart, endX, segmentEnd))
+					continue;
+
+				//FitsInt32Lanes guarantees every lane value of this box fits in 32 bits
+				Int edge01Check{ SimdFloat::AddInt(SimdFloat::Set1Int(int(edge01.RowValue(py) + edge01.stepX * segmentStart)), laneSteps01) };
+				Int edge12Check{ SimdFloat::AddInt(SimdFloat::Set1Int(int(edge12.RowValue(py) + edge12.stepX * segmentStart)), laneSteps12) };
+				Int edge20Check{ SimdFloat::AddInt(SimdFloat::Set1Int(int(edge20.RowValue(py) + edge20.stepX * segmentStart)), laneSteps20) };
+
+				for (int px{ segmentStart }; px < segmentEnd; px += SimdFloat::Width)
+				{
+					const int numLanes{ std::min(SimdFloat::Width, segmentEnd - px) };
+					const int pixelIdx{ py * m_Width + px };
+
+					//The span is exact, so only the lanes past its end are masked off
+					int coverage{ (1 << numLanes) - 1 };
+
+					const Float weightV2{ SimdFloat::Mul(SimdFloat::ToFloat(edge01Check), weightScale) };
+					const Float weightV0{ SimdFloat::Mul(SimdFloat::ToFloat(edge12Check), weightScale) };
+					const Float weightV1{ SimdFloat::Mul(SimdFloat::ToFloat(edge20Check), weightScale) };
+
+					edge01Check = SimdFloat::AddInt(edge01Check, blockStep01);
+					edge12Check = SimdFloat::AddInt(edge12Check, blockStep12);
+					edge20Check = SimdFloat::AddInt(edge20Check, blockStep20);
+
+					const Float interpolatedZ{ SimdFloat::Div(one, SimdFloat::Add(SimdFloat::Add(
+						SimdFloat::Mul(weightV0, invZ0),
+						SimdFloat::Mul(weightV1, invZ1)),
+						SimdFloat::Mul(weightV2, invZ2))) };
+
+					//depth test, a partial block must not read pixels past the span (they can belong to another tile or lie past the buffer)
+					const Float depth{ numLanes == SimdFloat::Width ?
+						SimdFloat::Load(m_pDepthBufferPixels + pixelIdx) :
+						SimdFloat::LoadPartial(m_pDepthBufferPixels + pixelIdx, numLanes, 0.f) };
+					coverage &= SimdFloat::MoveMask(SimdFloat::CmpLt(interpolatedZ, depth));
+					if (coverage == 0)
+						continue;
+
+					//Deferred mode only needs depth and the triangle index here, the attributes are interpolated in the shading pass
+					if (m_UseDeferredShading)
+					{
+						SimdFloat::Store(laneZ, interpolatedZ);
+						for (int lane{}; lane < numLanes; ++lane)
+						{
+							if ((coverage & (1 << lane)) == 0)
+								continue;
+
+							m_pDepthBufferPixels[pixelIdx + lane] = laneZ[lane];
+							m_pVisibilityBufferPixels[pixelIdx + lane] = triangleIdx + 1;
+						}
+						continue;
+					}
+
+					const Float interpolatedW{ SimdFloat::Div(one, SimdFloat::Add(SimdFloat::Add(
+						SimdFloat::Mul(weightV0, invW0),
+						SimdFloat::Mul(weightV1, invW1)),
+						SimdFloat::Mul(weightV2, invW2))) };
+
+					Float interpolatedUV[2]{};
+					for (int i{}; i < numAttributes; ++i)
+					{
+						const Float interpolated{ SimdFloat::Mul(SimdFloat::Add(SimdFloat::Add(
+							SimdFloat::Mul(weightV0, attributes0[i]),
+							SimdFloat::Mul(weightV1, attributes1[i])),
+							SimdFloat::Mul(weightV2, attributes2[i])), interpolatedW) };
+						SimdFloat::Store(laneAttributes[i], interpolated);
+						if (i < 2)
+							interpolatedUV[i] = interpolated;
+					}
+					//Same quotient rule as InterpolateFragment
+					for (int i{}; i < numDerivatives; ++i)
+					{
+						const Float derivative{ SimdFloat::Mul(SimdFloat::Sub(uvOverWGradients[i],
+							SimdFloat::Mul(interpolatedUV[i % 2], invWGradients[i])), interpolatedW) };
+						SimdFloat::Store(laneDerivatives[i], derivative);
+					}
+					SimdFloat::Store(laneZ, interpolatedZ);
+
+					//Depth and color are written per lane, so pixels outside the coverage mask are never touched
+					for (int lane{}; lane < numLanes; ++lane)
+					{
+						if ((coverage & (1 << lane)) == 0)
+							continue;
+
+						WriteFragment(laneZ[lane],
+							{ laneAttributes[0][lane], laneAttributes[1][lane] },
+							{ laneDerivatives[0][lane], laneDerivatives[1][lane] },
+							{ laneDerivatives[2][lane], laneDerivatives[3][lane] },
+							{ laneAttributes[2][lane], laneAttributes[3][lane], laneAttributes[4][lane] },
+							{ laneAttributes[5][lane], laneAttributes[6][lane], laneAttributes[7][lane] },
+							{ laneAttributes[8][lane], laneAttributes[9][lane], laneAttributes[10][lane] },
+							pixelIdx + lane);
+					}
+				}
+			}
+		}
+	}
+
+	float Renderer::InterpolateDepth(const RasterTriangle& triangle, float weightV0, float weightV1, float weightV2)
+	{
+		return 1.f / (
+			weightV0 / triangle.v0.position.z +
+			weightV1 / triangle.v1.position.z +
+			weightV2 / triangle.v2.position.z);
+	}
+
+	void Renderer::ShadeFragment(const RasterTriangle& triangle, float weightV0, float weightV1, float weightV2, int pixelIdx) const
+	{
+		const float interpolatedZ{ InterpolateDepth(triangle, weightV0, weightV1, weightV2) };
+
+		//depth test
+		if (interpolatedZ >= m_pDepthBufferPixels[pixelIdx])
+			return;
+
+		InterpolateFragment(triangle, interpolatedZ, weightV0, weightV1, weightV2, pixelIdx);
+	}
+
+	void Renderer::WriteVisibility(uint32_t triangleIdx, float weightV0, float weightV1, float weightV2, int pixelIdx) const
+	{
+		const float interpolatedZ{ InterpolateDepth(m_RasterTriangles[triangleIdx], weightV0, weightV1, weightV2) };
+
+		//depth test
+		if (interpolatedZ >= m_pDepthBufferPixels[pixelIdx])
+			return;
+
+		m_pDepthBufferPixels[pixelIdx] = interpolatedZ;
+		m_pVisibilityBufferPixels[pixelIdx] = triangleIdx + 1;
+	}
+
+	void Renderer::ShadeVisibilityBuffer(int minX, int minY, int maxX, int maxY) const
+	{
+		//Neighbouring pixels mostly show the same triangle, so its edges are only set up again when the index changes
+		uint32_t cachedVisibility{};
+		EdgeFunction edge01{};
+		EdgeFunction edge12{};
+		EdgeFunction edge20{};
+		float weightScale{};
+
+		for (int py{ minY }; py < maxY; ++py)
+		{
+			for (int px{ minX }; px < maxX; ++px)
+			{
+				const int pixelIdx{ py * m_Width + px };
+				const uint32_t visibility{ m_pVisibilityBufferPixels[pixelIdx] };
+				if (visibility == 0)
+					continue;
+
+				const RasterTriangle& triangle{ m_RasterTriangles[visibility - 1] };
+				if (visibility != cachedVisibility)
+				{
+					cachedVisibility = visibility;
+					edge01 = SetupEdge(triangle.fixed0, triangle.fixed1);
+					edge12 = SetupEdge(triangle.fixed1, triangle.fixed2);
+					edge20 = SetupEdge(triangle.fixed2, triangle.fixed0);
+					weightScale = 0.5f / float(triangle.doubleArea);
+				}
+
+				//The exact integer edge values make these the same weights the raster pass had
+				const float weightV2{ float(edge01.RowValue(py) + edge01.stepX * px) * weightScale };
+				const float weightV0{ float(edge12.RowValue(py) + edge12.stepX * px) * weightScale };
+				const float weightV1{ float(edge20.RowValue(py) + edge20.stepX * px) * weightScale };
+
+				InterpolateFragment(triangle, m_pDepthBufferPixels[pixelIdx], weightV0, weightV1, weightV2, pixelIdx);
+			}
+		}
+	}
+
+	void Renderer::InterpolateFragment(const RasterTriangle& triangle, float interpolatedZ, float weightV0, float weightV1, float weightV2, int pixelIdx) const
+	{
+		const Vertex_Out& worldV0{ triangle.v0 };
+		const Vertex_Out& worldV1{ triangle.v1 };
+		const Vertex_Out& worldV2{ triangle.v2 };
+
+		const float interpolatedW
+		{
+			 1.f / (
+					(weightV0 / worldV0.position.w) +
+					(weightV1 / worldV1.position.w) +
+					(weightV2 / worldV2.position.w)
+				   )
+		};
+		const Vector2 interpolatedUV
+		{
+			(
+				(weightV0 * worldV0.uv / worldV0.position.w) +
+				(weightV1 * worldV1.uv / worldV1.position.w) +
+				(weightV2 * worldV2.uv / worldV2.position.w)
+			) * interpolatedW
+		};
+		//Quotient rule on (uv / w) / (1 / w), exact at the pixel center instead of a finite difference over a quad
+		const Vector2 uvDx{ (triangle.uvOverWDx - interpolatedUV * triangle.invWDx) * interpolatedW };
+		const Vector2 uvDy{ (triangle.uvOverWDy - interpolatedUV * triangle.invWDy) * interpolatedW };
+
+		const Vector3 interpolatedNormal
+		{
+			(
+				(weightV0 * worldV0.normal / worldV0.position.w) +
+				(weightV1 * worldV1.normal / worldV1.position.w) +
+				(weightV2 * worldV2.normal / worldV2.position.w)
+			) * interpolatedW
+		};
+
+		const Vector3 interpolatedTangent
+		{
+			(
+				(weightV0 * worldV0.tangent / worldV0.position.w) +
+				(weightV1 * worldV1.tangent / worldV1.position.w) +
+				(weightV2 * worldV2.tangent / worldV2.position.w)
+			) * interpolatedW
+		};
+
+		const Vector3 interpolatedWorldPosition
+		{
+			(
+				(weightV0 * worldV0.worldPosition / worldV0.position.w) +
+				(weightV1 * worldV1.worldPosition / worldV1.position.w) +
+				(weightV2 * worldV2.worldPosition / worldV2.position.w)
+			) * interpolatedW
+		};
+
+		WriteFragment(interpolatedZ, interpolatedUV, uvDx, uvDy, interpolatedNormal, interpolatedTangent, interpolatedWorldPosition, pixelIdx);
+	}
+
+	void Renderer::WriteFragment(float interpolatedZ, const Vector2& interpolatedUV, const Vector2& uvDx, const Vector2& uvDy, const Vector3& interpolatedNormal, const Vector3& interpolatedTangent, const Vector3& interpolatedWorldPosition, int pixelIdx) const
+	{
+		//depth write
+		const float depthColor{ Remap(interpolatedZ,1.995f,2.f) - 1.f };
+		m_pDepthBufferPixels[pixelIdx] = interpolatedZ;
+		(this->*m_pPixelShader)({ {},{depthColor,depthColor,depthColor},interpolatedUV,interpolatedNormal,interpolatedTangent, interpolatedWorldPosition }, uvDx, uvDy, pixelIdx);
+	}
+
+	bool Renderer::PrepareShadowMap(const std::vector<Mesh*>& meshes) const
+	{
+		m_ShadowLightIdx = -1;
+
+		//None of these shade with the lights
+		if (!m_UseShadows || m_UseDepthBufferVis || m_UseBBVis || m_LightingMode == LightingMode::Diffuse || meshes.empty())
+			return false;
+
+		const auto isShadowCaster = [](const Light& light) { return light.type == Light::Type::Directional && light.castsShadows; };
+		const auto caster{ std::find_if(m_Lights.begin(), m_Lights.end(), isShadowCaster) };
+		if (caster == m_Lights.end())
+			return false;
+
+		//Smallest sphere around the spheres of all meshes, the world matrices only rotate and translate so the radii carry over
+		Vector3 center{};
+		float radius{ -1.f };
+		for (Mesh* pMesh : meshes)
+		{
+			const VertexStreams& streams{ pMesh->GetVertexStreams() };
+			const Vector3 meshCenter{ pMesh->GetWorldMatrix().TransformPoint(streams.boundsCenter) };
+			const float distance{ (meshCenter - center).Magnitude() };
+			if (radius < 0.f || distance + radius <= streams.boundsRadius)
+			{
+				center = meshCenter;
+				radius = streams.boundsRadius;
+			}
+			else if (distance + streams.boundsRadius > radius)
+			{
+				const float mergedRadius{ (distance + radius + streams.boundsRadius) / 2.f };
+				center += (meshCenter - center) * ((mergedRadius - radius) / distance);
+				radius = mergedRadius;
+			}
+		}
+		if (radius <= 0.f)
+			return false;
+
+		//Light space like a camera looking down the light direction, then scaled so the sphere's square fills the map
+		//x goes right and y down in texels like raster coordinates, depth goes from 0 to 1 through the sphere
+		const Vector3 forward{ caster->direction };
+		const Vector3 right{ Vector3::Cross(std::abs(forward.y) < 0.99f ? Vector3::UnitY : Vector3::UnitX, forward).Normalized() };
+		const Vector3 up{ Vector3::Cross(forward, right) };
+		const float texelsPerUnit{ ShadowMapSize / (2.f * radius) };
+		const float depthPerUnit{ 1.f / (2.f * radius) };
+		const float halfSize{ ShadowMapSize / 2.f };
+		m_ShadowMatrix = Matrix
+		{
+			Vector4{ right.x * texelsPerUnit, -up.x * texelsPerUnit, forward.x * depthPerUnit, 0.f },
+			Vector4{ right.y * texelsPerUnit, -up.y * texelsPerUnit, forward.y * depthPerUnit, 0.f },
+			Vector4{ right.z * texelsPerUnit, -up.z * texelsPerUnit, forward.z * depthPerUnit, 0.f },
+			Vector4{ halfSize - Vector3::Dot(right, center) * texelsPerUnit, halfSize + Vector3::Dot(up, center) * texelsPerUnit, 0.5f - Vector3::Dot(forward, center) * depthPerUnit, 1.f }
+		};
+		m_ShadowTexelSize = 1.f / texelsPerUnit;
+		m_ShadowLightIdx = int(caster - m_Lights.begin());
+		return true;
+	}
+
+	void Renderer::RenderShadowMap(const std::vector<Mesh*>& meshes) const
+	{
+		SetupShadowTriangles(meshes);
 
-		for (size_t meshIdx{}; meshIdx < m_pMeshes.size(); ++meshIdx)
+		for (std::vector<uint32_t>& bin : m_ShadowTileBins)
 		{
-
-			//loop over each defined triangle
-			for (size_t i{}; i < m_pMeshes[meshIdx]->GetIndices().size(); i += 3)
+			bin.clear();
+		}
+		for (uint32_t triangleIdx{}; triangleIdx < uint32_t(m_ShadowTriangles.size()); ++triangleIdx)
+		{
+			const ShadowTriangle& triangle{ m_ShadowTriangles[triangleIdx] };
+			for (int tileY{ triangle.minY / TileSize }; tileY <= (triangle.maxY - 1) / TileSize; ++tileY)
 			{
-				//indices of the triangle 
-				const uint32_t v0Idx{ m_pMeshes[meshIdx]->GetIndices()[i] };
-				const uint32_t v1Idx{ m_pMeshes[meshIdx]->GetIndices()[i + 1] };
-				const uint32_t v2Idx{ m_pMeshes[meshIdx]->GetIndices()[i + 2] };
-
-				//dont render degenerate triangles
-				if (v0Idx == v1Idx || v1Idx == v2Idx || v0Idx == v2Idx)
-					continue;
-
-				//Vertices
-				const Vertex_Out worldV0{ m_pMeshes[meshIdx]->GetVerticesOut()[v0Idx] };
-				const Vertex_Out worldV1{ m_pMeshes[meshIdx]->GetVerticesOut()[v1Idx] };
-				const Vertex_Out worldV2{ m_pMeshes[meshIdx]->GetVerticesOut()[v2Idx] };
+				for (int tileX{ triangle.minX / TileSize }; tileX <= (triangle.maxX - 1) / TileSize; ++tileX)
+				{
+					m_ShadowTileBins[tileY * NumShadowTiles + tileX].emplace_back(triangleIdx);
+				}
+			}
+		}
 
-				//Screen-space vertex coordinates
-				const Vector2 v0{ rasterVertices[v0Idx] };
-				const Vector2 v1{ rasterVertices[v1Idx] };
-				const Vector2 v2{ rasterVertices[v2Idx] };
+		//Each tile clears and writes only its own texels; depth only ever takes the min, so the order of the triangles doesn't matter
+		m_pThreadPool->ParallelFor(uint32_t(m_ShadowTileBins.size()), [this](uint32_t tileIdx)
+			{
+				const int tileMinX{ int(tileIdx) % NumShadowTiles * TileSize };
+				const int tileMinY{ int(tileIdx) / NumShadowTiles * TileSize };
+				const int tileMaxX{ tileMinX + TileSize };
+				const int tileMaxY{ tileMinY + TileSize };
 
-				if (!IsInFrustum(worldV0, worldV1, worldV2))
+				for (int py{ tileMinY }; py < tileMaxY; ++py)
 				{
-					continue;
+					std::fill(m_pShadowMapPixels + py * ShadowMapSize + tileMinX, m_pShadowMapPixels + py * ShadowMapSize + tileMaxX, FLT_MAX);
 				}
-				if (m_pMeshes[meshIdx]->GetCullMode() != Mesh::CullMode::None)
+				for (const uint32_t triangleIdx : m_ShadowTileBins[tileIdx])
 				{
-					//Calculate average triangle normal from the vertex normals we get from parsing the OBJ
-					Vector3 avgNormal{ (worldV0.normal + worldV1.normal + worldV2.normal) / 3.0f };
-					avgNormal = avgNormal.Normalized();
-
-					Vector3 camViewVec{ -m_pCamera->GetInvViewMatrix().GetAxisZ() };
-				
-					float dotProduct{ Vector3::Dot(avgNormal,camViewVec) };
-
-					if (m_pMeshes[meshIdx]->GetCullMode() == Mesh::CullMode::Back)
-					{
-						if(dotProduct < 0)
-							continue;
-					}
-					else if (m_pMeshes[meshIdx]->GetCullMode() == Mesh::CullMode::Front)
-					{
-						if(dotProduct > 0)
-							continue;
-					}
-
+					RasterizeShadowTriangle(triangleIdx, tileMinX, tileMinY, tileMaxX, tileMaxY);
 				}
+			});
+	}
 
-				//Edges in screen-space 
-				const Vector2 edge01{ v1 - v0 };
-				const Vector2 edge12{ v2 - v1 };
-				const Vector2 edge20{ v0 - v2 };
+	void Renderer::SetupShadowTriangles(const std::vector<Mesh*>& meshes) const
+	{
+		m_ShadowTriangles.clear();
 
-				const float totalTriangleArea{ Vector2::Cross(edge01,edge12) };
+		//Every triangle casts, no matter the cull mode: the light sees the sides the camera culls
+		for (size_t meshIdx{}; meshIdx < meshes.size(); ++meshIdx)
+		{
+			const std::vector<uint32_t>& indices{ meshes[meshIdx]->GetIndices() };
+			const TransformedMesh& transformed{ m_TransformedMeshes[meshIdx] };
+			const auto toShadow = [&transformed](uint32_t vertexIdx) -> Vector3
+				{
+					return { transformed.pShadowX[vertexIdx], transformed.pShadowY[vertexIdx], transformed.pShadowDepth[vertexIdx] };
+				};
 
-				Vector2 BBTopLeft{};
-				Vector2 BBBottomRight{};
-				CreateBoundingBox(v0, v1, v2, BBTopLeft, BBBottomRight);
+			for (size_t i{}; i < indices.size(); i += 3)
+			{
+				const uint32_t v0Idx{ indices[i] };
+				const uint32_t v1Idx{ indices[i + 1] };
+				const uint32_t v2Idx{ indices[i + 2] };
+				if (v0Idx == v1Idx || v1Idx == v2Idx || v0Idx == v2Idx)
+					continue;
 
-				//RENDER LOGIC
-				for (int px{ int(std::ceil(BBTopLeft.x)) }; px < int(std::ceil(BBBottomRight.x)); ++px)
-				{
-					for (int py{ int(std::ceil(BBTopLeft.y)) }; py < int(std::ceil(BBBottomRight.y)); ++py)
-					{
-						const Vector2 currentPixel{ float(px), float(py) };
+				AddShadowTriangle(toShadow(v0Idx), toShadow(v1Idx), toShadow(v2Idx));
+			}
+		}
+	}
 
-						const Vector2 v0ToCurrentPixel{ currentPixel - v0 };
-						const Vector2 v1ToCurrentPixel{ currentPixel - v1 };
-						const Vector2 v2ToCurrentPixel{ currentPixel - v2 };
+	void Renderer::AddShadowTriangle(const Vector3& shadow0, const Vector3& shadow1, const Vector3& shadow2) const
+	{
+		//Same fixed point snapping and coverage rules as the frame's triangles
+		const auto toFixed = [](const Vector3& shadow) -> Int2
+			{
+				return { int(std::lround(shadow.x * SubPixelScale)), int(std::lround(shadow.y * SubPixelScale)) };
+			};
+		ShadowTriangle triangle{};
+		triangle.fixed0 = toFixed(shadow0);
+		triangle.fixed1 = toFixed(shadow1);
+		triangle.fixed2 = toFixed(shadow2);
+		float depth0{ shadow0.z };
+		float depth1{ shadow1.z };
+		float depth2{ shadow2.z };
+
+		triangle.doubleArea =
+			(int64_t(triangle.fixed1.x) - triangle.fixed0.x) * (int64_t(triangle.fixed2.y) - triangle.fixed1.y) -
+			(int64_t(triangle.fixed1.y) - triangle.fixed0.y) * (int64_t(triangle.fixed2.x) - triangle.fixed1.x);
+		//Both sides cast, a triangle facing away from the light gets the winding the edge functions expect
+		if (triangle.doubleArea < 0)
+		{
+			std::swap(triangle.fixed1, triangle.fixed2);
+			std::swap(depth1, depth2);
+			triangle.doubleArea = -triangle.doubleArea;
+		}
+		if (triangle.doubleArea == 0)
+			return;
 
-						const float edge01Check{ Vector2::Cross(edge01,v0ToCurrentPixel) };
-						const float edge12Check{ Vector2::Cross(edge12,v1ToCurrentPixel) };
-						const float edge20Check{ Vector2::Cross(edge20,v2ToCurrentPixel) };
+		//Same as CreateBoundingBox, clamped to the map
+		constexpr int halfPixel{ SubPixelScale / 2 };
+		triangle.minX = std::clamp(((std::min({ triangle.fixed0.x, triangle.fixed1.x, triangle.fixed2.x }) - halfPixel + SubPixelScale - 1) >> SubPixelBits), 0, ShadowMapSize);
+		triangle.minY = std::clamp(((std::min({ triangle.fixed0.y, triangle.fixed1.y, triangle.fixed2.y }) - halfPixel + SubPixelScale - 1) >> SubPixelBits), 0, ShadowMapSize);
+		triangle.maxX = std::clamp(((std::max({ triangle.fixed0.x, triangle.fixed1.x, triangle.fixed2.x }) - halfPixel) >> SubPixelBits) + 1, 0, ShadowMapSize);
+		triangle.maxY = std::clamp(((std::max({ triangle.fixed0.y, triangle.fixed1.y, triangle.fixed2.y }) - halfPixel) >> SubPixelBits) + 1, 0, ShadowMapSize);
+		if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
+			return;
 
+		//The weights of the frame's triangles, summing to 1 here; in double so the plane doesn't lose the depth of thin triangles
+		const EdgeFunction edge01{ SetupEdge(triangle.fixed0, triangle.fixed1) };
+		const EdgeFunction edge12{ SetupEdge(triangle.fixed1, triangle.fixed2) };
+		const EdgeFunction edge20{ SetupEdge(triangle.fixed2, triangle.fixed0) };
+		const double invDoubleArea{ 1.0 / double(triangle.doubleArea) };
+		const auto weightedDepth = [=](int64_t value12, int64_t value20, int64_t value01)
+			{
+				return (double(value12) * depth0 + double(value20) * depth1 + double(value01) * depth2) * invDoubleArea;
+			};
+		triangle.depth = float(weightedDepth(
+			edge12.RowValue(triangle.minY) + edge12.stepX * triangle.minX,
+			edge20.RowValue(triangle.minY) + edge20.stepX * triangle.minX,
+			edge01.RowValue(triangle.minY) + edge01.stepX * triangle.minX));
+		triangle.depthDx = float(weightedDepth(edge12.stepX, edge20.stepX, edge01.stepX));
+		triangle.depthDy = float(weightedDepth(edge12.stepY, edge20.stepY, edge01.stepY));
+
+		m_ShadowTriangles.emplace_back(triangle);
+	}
 
-						if (m_UseBBVis)
-						{
-							ColorRGB finalColor{ 1,0,0 };
-							finalColor.MaxToOne();
-							m_pBackBufferPixels[py * m_Width + px] = SDL_MapRGB(m_pBackBuffer->format, Uint8(finalColor.r * 255), Uint8(finalColor.g * 255), Uint8(finalColor.b * 255));
-							continue;
-						}
+	void Renderer::RasterizeShadowTriangle(uint32_t triangleIdx, int clipMinX, int clipMinY, int clipMaxX, int clipMaxY) const
+	{
+		const ShadowTriangle& triangle{ m_ShadowTriangles[triangleIdx] };
 
-						//check if point is in triangle
-						if ((edge01Check > 0 && edge12Check > 0 && edge20Check > 0) == false)
-						{
-							continue;
-						}
+		const int minX{ std::max(triangle.minX, clipMinX) };
+		const int minY{ std::max(triangle.minY, clipMinY) };
+		const int maxX{ std::min(triangle.maxX, clipMaxX) };
+		const int maxY{ std::min(triangle.maxY, clipMaxY) };
 
+		const EdgeFunction edge01{ SetupEdge(triangle.fixed0, triangle.fixed1) };
+		const EdgeFunction edge12{ SetupEdge(triangle.fixed1, triangle.fixed2) };
+		const EdgeFunction edge20{ SetupEdge(triangle.fixed2, triangle.fixed0) };
 
+		//Same 32 bit lane check as the frame's triangles, widened by a block on the left as well since the blocks start aligned
+		const int laneMinX{ std::max(minX - 8, 0) };
+		const bool fitsInt32Lanes
+		{
+			FitsInt32Lanes(edge01, laneMinX, minY, maxX, maxY) &&
+			FitsInt32Lanes(edge12, laneMinX, minY, maxX, maxY) &&
+			FitsInt32Lanes(edge20, laneMinX, minY, maxX, maxY)
+		};
 
+		switch (fitsInt32Lanes ? m_SimdLevel : Simd::Level::Scalar)
+		{
+		case Simd::Level::AVX2:
+			RasterizeShadowTriangleSimd<Simd::Float8>(triangle, edge01, edge12, edge20, minX, minY, maxX, maxY);
+			break;
+		case Simd::Level::SSE2:
+			RasterizeShadowTriangleSimd<Simd::Float4>(triangle, edge01, edge12, edge20, minX, minY, maxX, maxY);
+			break;
+		default:
+			RasterizeShadowTriangleScalar(triangle, edge01, edge12, edge20, minX, minY, maxX, maxY);
+			break;
+		}
+	}
 
-						const float signedAreav0v1{ edge01Check / 2.f };
-						const float signedAreav1v2{ edge12Check / 2.f };
-						const float signedAreav2v0{ edge20Check / 2.f };
+	void Renderer::RasterizeShadowTriangleScalar(const ShadowTriangle& triangle, const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20,
+		int minX, int minY, int maxX, int maxY) const
+	{
+		for (int py{ minY }; py < maxY; ++py)
+		{
+			int startX{ minX };
+			int endX{ maxX };
+			if (!FindSpan(edge01, edge12, edge20, py, startX, endX))
+				continue;
 
-						//Weights
-						const float weightV2{ signedAreav0v1 / totalTriangleArea };
-						const float weightV0{ signedAreav1v2 / totalTriangleArea };
-						const float weightV1{ signedAreav2v0 / totalTriangleArea };
+			float* pRow{ m_pShadowMapPixels + py * ShadowMapSize };
+			for (int px{ startX }; px < endX; ++px)
+			{
+				pRow[px] = std::min(pRow[px], GetShadowDepth(triangle, px, py));
+			}
+		}
+	}
 
-						const float interpolatedZ
-						{
-							 1.f / (
-									weightV0 / worldV0.position.z +
-									weightV1 / worldV1.position.z +
-									weightV2 / worldV2.position.z
-								   )
-						};
-						const float interpolatedW
-						{
-							 1.f / (
-									(weightV0 / worldV0.position.w) +
-									(weightV1 / worldV1.position.w) +
-									(weightV2 / worldV2.position.w)
-								   )
-						};
-						const Vector2 interpolatedUV
-						{
-							(
-								(weightV0 * worldV0.uv / worldV0.position.w) +
-								(weightV1 * worldV1.uv / worldV1.position.w) +
-								(weightV2 * worldV2.uv / worldV2.position.w)
-							) * interpolatedW
-						};
-						const Vector3 interpolatedNormal
-						{
-							(
-								(weightV0 * worldV0.normal / worldV0.position.w) +
-								(weightV1 * worldV1.normal / worldV1.position.w) +
-								(weightV2 * worldV2.normal / worldV2.position.w)
-							) * interpolatedW
-						};
-
-						const Vector3 interpolatedTangent
-						{
-							(
-								(weightV0 * worldV0.tangent / worldV0.position.w) +
-								(weightV1 * worldV1.tangent / worldV1.position.w) +
-								(weightV2 * worldV2.tangent / worldV2.position.w)
-							) * interpolatedW
-						};
-
-						const Vector3 interpolatedViewDir
-						{
-							(
-								(weightV0 * worldV0.viewDirection / worldV0.position.w) +
-								(weightV1 * worldV1.viewDirection / worldV1.position.w) +
-								(weightV2 * worldV2.viewDirection / worldV2.position.w)
-							) * interpolatedW
-						};
+	template<typename SimdFloat>
+	void Renderer::RasterizeShadowTriangleSimd(const ShadowTriangle& triangle, const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20,
+		int minX, int minY, int maxX, int maxY) const
+	{
+		using Float = typename SimdFloat::Float;
+		using Int = typename SimdFloat::Int;
 
-						float depth = m_pDepthBufferPixels[py * m_Width + px];
+		//Shadow triangles are a few texels wide on most rows, FindSpan's divisions would cost more than the texels themselves
+		//So every block of the bounding box tests the edges in its lanes instead, stepping them with integer adds only
+		//Blocks are aligned to the SIMD width and tiles to TileSize, so a block never reaches into another thread's tile
+		const int blockMinX{ minX / SimdFloat::Width * SimdFloat::Width };
 
-						//depth test
-						if (interpolatedZ < depth)
-						{
+		//Covered means E + bias > 0, so E + bias - 1 is negative in the lanes that aren't
+		const auto firstLanes = [blockMinX, minY](const EdgeFunction& edge)
+			{
+				return SimdFloat::AddInt(SimdFloat::Set1Int(int(edge.RowValue(minY) + edge.stepX * blockMinX + edge.bias - 1)), SimdFloat::LaneMultiples(int(edge.stepX)));
+			};
+		Int rowEdge01{ firstLanes(edge01) };
+		Int rowEdge12{ firstLanes(edge12) };
+		Int rowEdge20{ firstLanes(edge20) };
+		const Int rowStep01{ SimdFloat::Set1Int(int(edge01.stepY)) };
+		const Int rowStep12{ SimdFloat::Set1Int(int(edge12.stepY)) };
+		const Int rowStep20{ SimdFloat::Set1Int(int(edge20.stepY)) };
+		const Int blockStep01{ SimdFloat::Set1Int(int(edge01.stepX) * SimdFloat::Width) };
+		const Int blockStep12{ SimdFloat::Set1Int(int(edge12.stepX) * SimdFloat::Width) };
+		const Int blockStep20{ SimdFloat::Set1Int(int(edge20.stepX) * SimdFloat::Width) };
+
+		const Float depthDx{ SimdFloat::Set1(triangle.depthDx) };
+		const Float firstOffsets{ SimdFloat::Add(SimdFloat::Set1(float(blockMinX - triangle.minX)), SimdFloat::LaneOffsets()) };
+		const Float blockOffset{ SimdFloat::Set1(float(SimdFloat::Width)) };
+		constexpr int allOutside{ (1 << SimdFloat::Width) - 1 };
+
+		for (int py{ minY }; py < maxY; ++py)
+		{
+			float* pRow{ m_pShadowMapPixels + py * ShadowMapSize };
+			//Same operations as GetShadowDepth, so every texel gets the value the scalar path writes
+			const Float rowDepth{ SimdFloat::Set1(triangle.depth + triangle.depthDy * float(py - triangle.minY)) };
+
+			Int edge01Check{ rowEdge01 };
+			Int edge12Check{ rowEdge12 };
+			Int edge20Check{ rowEdge20 };
+			Float offsets{ firstOffsets };
+			for (int blockX{ blockMinX }; blockX < maxX; blockX += SimdFloat::Width)
+			{
+				const Float isOutside{ SimdFloat::NegativeMask(SimdFloat::OrInt(SimdFloat::OrInt(edge01Check, edge12Check), edge20Check)) };
+				if (SimdFloat::MoveMask(isOutside) != allOutside)
+				{
+					//Lanes outside the triangle write back what they read
+					const Float depth{ SimdFloat::Add(rowDepth, SimdFloat::Mul(depthDx, offsets)) };
+					const Float stored{ SimdFloat::Load(pRow + blockX) };
+					SimdFloat::Store(pRow + blockX, SimdFloat::Select(isOutside, stored, SimdFloat::Min(stored, depth)));
+				}
 
-							//depth write
-							const float depthColor{ Remap(interpolatedZ,1.995f,2.f) - 1.f };
-							m_pDepthBufferPixels[py * m_Width + px] = interpolatedZ;
-							if (m_UseDepthBufferVis)
-							{
-								ColorRGB finalColor{};
-								finalColor = { depthColor,depthColor,depthColor };
-								finalColor.MaxToOne();
-								m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-									static_cast<uint8_t>(finalColor.r * 255),
-									static_cast<uint8_t>(finalColor.g * 255),
-									static_cast<uint8_t>(finalColor.b * 255));
-							}
-							else
-							{
-								PixelShading({ {},{depthColor,depthColor,depthColor},interpolatedUV,interpolatedNormal,interpolatedTangent, interpolatedViewDir }, py * m_Width + px);
-							}
-						}
+				edge01Check = SimdFloat::AddInt(edge01Check, blockStep01);
+				edge12Check = SimdFloat::AddInt(edge12Check, blockStep12);
+				edge20Check = SimdFloat::AddInt(edge20Check, blockStep20);
+				offsets = SimdFloat::Add(offsets, blockOffset);
+			}
 
+			rowEdge01 = SimdFloat::AddInt(rowEdge01, rowStep01);
+			rowEdge12 = SimdFloat::AddInt(rowEdge12, rowStep12);
+			rowEdge20 = SimdFloat::AddInt(rowEdge20, rowStep20);
+		}
+	}
 
+	float Renderer::GetShadowDepth(const ShadowTriangle& triangle, int px, int py)
+	{
+		const float rowDepth{ triangle.depth + triangle.depthDy * float(py - triangle.minY) };
+		return rowDepth + triangle.depthDx * float(px - triangle.minX);
+	}
 
-					}
+	float Renderer::SampleShadow(const Vector3& worldPosition, const Vector3& normal) const
+	{
+		//Off the surface along the normal, on slopes the kernel would otherwise reach into the surface's own texels
+		const Vector3 shadowPosition{ m_ShadowMatrix.TransformPoint(worldPosition + normal * (ShadowNormalOffset * m_ShadowTexelSize)) };
+		//The whole map is 1 deep and ShadowMapSize texels wide, so this is ShadowDepthBias texels towards the light
+		const float receiverDepth{ shadowPosition.z - ShadowDepthBias / ShadowMapSize };
+
+		//A 3x3 box of texels that slides smoothly: the 4x4 texels around the position, the outer ones weighted by how far the box covers them
+		//Argument order matters, this way NaN ends up in a texel that exists as well
+		const float x{ std::max(std::min(float(ShadowMapSize - 1), shadowPosition.x - 0.5f), 0.f) };
+		const float y{ std::max(std::min(float(ShadowMapSize - 1), shadowPosition.y - 0.5f), 0.f) };
+		const int texelX{ int(x) };
+		const int texelY{ int(y) };
+		const float weightsX[4]{ 1.f - (x - float(texelX)), 1.f, 1.f, x - float(texelX) };
+		const float weightsY[4]{ 1.f - (y - float(texelY)), 1.f, 1.f, y - float(texelY) };
+		int columns[4]{};
+		const float* pRows[4]{};
+		for (int i{}; i < 4; ++i)
+		{
+			columns[i] = std::clamp(texelX - 1 + i, 0, ShadowMapSize - 1);
+			pRows[i] = m_pShadowMapPixels + std::clamp(texelY - 1 + i, 0, ShadowMapSize - 1) * ShadowMapSize;
+		}
 
-				}
+		float lit{};
+		for (int row{}; row < 4; ++row)
+		{
+			float rowLit{};
+			for (int column{}; column < 4; ++column)
+			{
+				rowLit += receiverDepth <= pRows[row][columns[column]] ? weightsX[column] : 0.f;
 			}
-
-			//@END
-		//Update SDL Surface
-			SDL_UnlockSurface(m_pBackBuffer);
-			SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
-			SDL_UpdateWindowSurface(m_pWindow);
+			lit += rowLit * weightsY[row];
 		}
+		return lit / 9.f;
 	}
 
 	void Renderer::UpdateBGColor()
@@ -381,6 +1579,9 @@ namespace dae {
 			m_LightingMode = LightingMode::Combined;
 			break;
 		case LightingMode::Combined:
+			m_LightingMode = LightingMode::PhysicallyBased;
+			break;
+		case LightingMode::PhysicallyBased:
 			m_LightingMode = LightingMode::ObservedArea;
 			break;
 		default:
@@ -391,6 +1592,13 @@ namespace dae {
 	}
 
 
+	void Renderer::CycleSimdLevel()
+	{
+		//Only cycles through the levels this CPU supports
+		const int numLevels{ static_cast<int>(m_MaxSimdLevel) + 1 };
+		m_SimdLevel = static_cast<Simd::Level>((static_cast<int>(m_SimdLevel) + 1) % numLevels);
+	}
+
 	HRESULT Renderer::InitializeDirectX()
 	{
 		//Create Device & Device Context:
@@ -532,55 +1740,200 @@ namespace dae {
 	void Renderer::DestructSoftware()
 	{
 		delete[] m_pDepthBufferPixels;
+		delete[] m_pVisibilityBufferPixels;
+		delete[] m_pShadowMapPixels;
+		delete m_pThreadPool;
+		delete m_pFrameArena;
+		delete m_pVehicleMaterial;
+		delete m_pTextureResidency;
+		delete m_pSplitSumLut;
 	}
 
-	void Renderer::VertexTransformationFunction(const std::vector<Mesh*>& mesh_in) const
+	void Renderer::PrepareTransformedMeshes(const std::vector<Mesh*>& meshes) const
 	{
-		std::vector<Vertex_Out> temp{};
-		for (const auto& m : mesh_in)
+		//The arena isn't thread safe, so every stream is allocated up front and the workers only fill them in
+		for (size_t meshIdx{}; meshIdx < meshes.size(); ++meshIdx)
 		{
-			const Matrix worldViewProjection{ m->GetWorldMatrix() * m_pCamera->GetViewMatrix() * m_pCamera->GetProjectionMatrix() };
-
-			for (const Vertex& v : m->GetVertices())
+			Mesh* m{ meshes[meshIdx] };
+			const VertexStreams& input{ m->GetVertexStreams() };
+
+			//The streams keep the padding of the input, so the last batch can be a full SIMD width as well
+			const size_t paddedSize{ input.positionX.size() };
+			TransformedMesh& output{ m_TransformedMeshes[meshIdx] };
+			output.numVertices = input.numVertices;
+			float** streams[TransformedMesh::NumStreams]
 			{
-				Vertex_Out vOut{ {},v.color,v.uv };
-				vOut.position = worldViewProjection.TransformPoint({ v.position,1.f });
+				&output.pPositionX, &output.pPositionY, &output.pPositionZ, &output.pPositionW,
+				&output.pRasterX, &output.pRasterY,
+				&output.pNormalX, &output.pNormalY, &output.pNormalZ,
+				&output.pTangentX, &output.pTangentY, &output.pTangentZ,
+				&output.pWorldPositionX, &output.pWorldPositionY, &output.pWorldPositionZ,
+				&output.pShadowX, &output.pShadowY, &output.pShadowDepth
+			};
+			for (float** ppStream : streams)
+			{
+				*ppStream = m_pFrameArena->Allocate<float>(paddedSize);
+			}
 
-				//perspective divide to convert to NDC
-				vOut.position.x = vOut.position.x / vOut.position.w;
-				vOut.position.y = vOut.position.y / vOut.position.w;
-				vOut.position.z = vOut.position.z / vOut.position.w;
+			output.world = m->GetWorldMatrix();
+			output.worldViewProjection = output.world * m_pCamera->GetViewMatrix() * m_pCamera->GetProjectionMatrix();
+			output.worldShadow = output.world * m_ShadowMatrix;
+		}
 
-				vOut.normal = m->GetWorldMatrix().TransformVector(v.normal);
-				vOut.tangent = m->GetWorldMatrix().TransformVector(v.tangent);
+		for (std::atomic<bool>& isDone : m_IsVertexChunkDone)
+		{
+			isDone.store(false, std::memory_order_relaxed);
+		}
+	}
 
-				vOut.viewDirection = v.position;
-				vOut.viewDirection = vOut.viewDirection.Normalized();
+	void Renderer::TransformVertexChunk(uint32_t chunkIdx) const
+	{
+		const VertexChunk& chunk{ m_VertexChunks[chunkIdx] };
+		const VertexStreams& input{ m_pSoftwareMeshes[chunk.meshIdx]->GetVertexStreams() };
+		const TransformedMesh& output{ m_TransformedMeshes[chunk.meshIdx] };
 
+		switch (m_SimdLevel)
+		{
+		case Simd::Level::AVX2:
+			TransformVertices<Simd::Float8>(input, output, chunk.begin, chunk.end);
+			break;
+		case Simd::Level::SSE2:
+			TransformVertices<Simd::Float4>(input, output, chunk.begin, chunk.end);
+			break;
+		default:
+			TransformVertices<Simd::Float1>(input, output, chunk.begin, chunk.end);
+			break;
+		}
 
-				temp.emplace_back(vOut);
-			}
-			m->SetVerticesOut(temp);
+		//Release, so whoever sees the flag also sees the streams
+		m_IsVertexChunkDone[chunkIdx].store(true, std::memory_order_release);
+	}
 
+	void Renderer::WaitForVertexChunk(ThreadPool::Batch& batch, uint32_t chunkIdx) const
+	{
+		while (!m_IsVertexChunkDone[chunkIdx].load(std::memory_order_acquire))
+		{
+			//Chunks are handed out in order, so as long as this one isn't taken yet, helping out gets closer to it
+			if (!ThreadPool::RunNext(batch))
+				std::this_thread::yield();
 		}
 	}
 
-	void Renderer::ConvertToRaster(const std::vector<Mesh*>& meshes, std::vector<Vector2>& rasterVerts) const
+	template<typename SimdFloat>
+	void Renderer::TransformVertices(const VertexStreams& input, const TransformedMesh& output, size_t begin, size_t end) const
 	{
-		for (const auto& mesh : meshes)
+		using Float = typename SimdFloat::Float;
+
+		//Same math and order as Matrix::TransformPoint/TransformVector, only for Width vertices at once
+		Float wvp[4][4]{};
+		Float world[4][3]{};
+		Float worldShadow[4][3]{};
+		for (int row{}; row < 4; ++row)
 		{
-			for (const auto& ndc : mesh->GetVerticesOut())
+			for (int column{}; column < 4; ++column)
 			{
-
-				rasterVerts.push_back(
-
-					{ ((ndc.position.x + 1) / 2.0f) * m_Width,
-					((1.0f - ndc.position.y) / 2.0f) * m_Height }
-				);
+				wvp[row][column] = SimdFloat::Set1(output.worldViewProjection[row][column]);
+				if (column < 3)
+				{
+					world[row][column] = SimdFloat::Set1(output.world[row][column]);
+					worldShadow[row][column] = SimdFloat::Set1(output.worldShadow[row][column]);
+				}
+			}
+		}
+		const auto transformPoint = [&wvp](Float x, Float y, Float z, int column)
+			{
+				return SimdFloat::Add(SimdFloat::Add(SimdFloat::Add(
+					SimdFloat::Mul(wvp[0][column], x),
+					SimdFloat::Mul(wvp[1][column], y)),
+					SimdFloat::Mul(wvp[2][column], z)),
+					wvp[3][column]);
+			};
+		const auto transformVector = [&world](Float x, Float y, Float z, int column)
+			{
+				return SimdFloat::Add(SimdFloat::Add(
+					SimdFloat::Mul(world[0][column], x),
+					SimdFloat::Mul(world[1][column], y)),
+					SimdFloat::Mul(world[2][column], z));
+			};
+
+		//The shadow projection is orthographic, no divide
+		const auto transformShadow = [&worldShadow](Float x, Float y, Float z, int column)
+			{
+				return SimdFloat::Add(SimdFloat::Add(SimdFloat::Add(
+					SimdFloat::Mul(worldShadow[0][column], x),
+					SimdFloat::Mul(worldShadow[1][column], y)),
+					SimdFloat::Mul(worldShadow[2][column], z)),
+					worldShadow[3][column]);
+			};
+		const bool hasShadowMap{ m_ShadowLightIdx >= 0 };
+
+		const Float one{ SimdFloat::Set1(1.f) };
+		const Float half{ SimdFloat::Set1(0.5f) };
+		const Float width{ SimdFloat::Set1(float(m_Width)) };
+		const Float height{ SimdFloat::Set1(float(m_Height)) };
+
+		for (size_t i{ begin }; i < end; i += SimdFloat::Width)
+		{
+			const Float x{ SimdFloat::Load(input.positionX.data() + i) };
+			const Float y{ SimdFloat::Load(input.positionY.data() + i) };
+			const Float z{ SimdFloat::Load(input.positionZ.data() + i) };
+
+			//perspective divide to convert to NDC
+			const Float w{ transformPoint(x, y, z, 3) };
+			const Float ndcX{ SimdFloat::Div(transformPoint(x, y, z, 0), w) };
+			const Float ndcY{ SimdFloat::Div(transformPoint(x, y, z, 1), w) };
+			SimdFloat::Store(output.pPositionX + i, ndcX);
+			SimdFloat::Store(output.pPositionY + i, ndcY);
+			SimdFloat::Store(output.pPositionZ + i, SimdFloat::Div(transformPoint(x, y, z, 2), w));
+			SimdFloat::Store(output.pPositionW + i, w);
+
+			//NDC to Raster/Screen Space, same as NdcToRaster
+			SimdFloat::Store(output.pRasterX + i, SimdFloat::Mul(SimdFloat::Mul(SimdFloat::Add(ndcX, one), half), width));
+			SimdFloat::Store(output.pRasterY + i, SimdFloat::Mul(SimdFloat::Mul(SimdFloat::Sub(one, ndcY), half), height));
+
+			SimdFloat::Store(output.pWorldPositionX + i, SimdFloat::Add(transformVector(x, y, z, 0), world[3][0]));
+			SimdFloat::Store(output.pWorldPositionY + i, SimdFloat::Add(transformVector(x, y, z, 1), world[3][1]));
+			SimdFloat::Store(output.pWorldPositionZ + i, SimdFloat::Add(transformVector(x, y, z, 2), world[3][2]));
+
+			if (hasShadowMap)
+			{
+				SimdFloat::Store(output.pShadowX + i, transformShadow(x, y, z, 0));
+				SimdFloat::Store(output.pShadowY + i, transformShadow(x, y, z, 1));
+				SimdFloat::Store(output.pShadowDepth + i, transformShadow(x, y, z, 2));
 			}
+
+			const Float normalX{ SimdFloat::Load(input.normalX.data() + i) };
+			const Float normalY{ SimdFloat::Load(input.normalY.data() + i) };
+			const Float normalZ{ SimdFloat::Load(input.normalZ.data() + i) };
+			SimdFloat::Store(output.pNormalX + i, transformVector(normalX, normalY, normalZ, 0));
+			SimdFloat::Store(output.pNormalY + i, transformVector(normalX, normalY, normalZ, 1));
+			SimdFloat::Store(output.pNormalZ + i, transformVector(normalX, normalY, normalZ, 2));
+
+			const Float tangentX{ SimdFloat::Load(input.tangentX.data() + i) };
+			const Float tangentY{ SimdFloat::Load(input.tangentY.data() + i) };
+			const Float tangentZ{ SimdFloat::Load(input.tangentZ.data() + i) };
+			SimdFloat::Store(output.pTangentX + i, transformVector(tangentX, tangentY, tangentZ, 0));
+			SimdFloat::Store(output.pTangentY + i, transformVector(tangentX, tangentY, tangentZ, 1));
+			SimdFloat::Store(output.pTangentZ + i, transformVector(tangentX, tangentY, tangentZ, 2));
 		}
 	}
 
+	Vertex_Out Renderer::GatherVertex(const VertexStreams& input, const TransformedMesh& transformed, uint32_t vertexIdx)
+	{
+		Vertex_Out vertex{};
+		vertex.position = { transformed.pPositionX[vertexIdx], transformed.pPositionY[vertexIdx], transformed.pPositionZ[vertexIdx], transformed.pPositionW[vertexIdx] };
+		vertex.uv = { input.u[vertexIdx], input.v[vertexIdx] };
+		vertex.normal = { transformed.pNormalX[vertexIdx], transformed.pNormalY[vertexIdx], transformed.pNormalZ[vertexIdx] };
+		vertex.tangent = { transformed.pTangentX[vertexIdx], transformed.pTangentY[vertexIdx], transformed.pTangentZ[vertexIdx] };
+		vertex.worldPosition = { transformed.pWorldPositionX[vertexIdx], transformed.pWorldPositionY[vertexIdx], transformed.pWorldPositionZ[vertexIdx] };
+		return vertex;
+	}
+
+	Vector2 Renderer::NdcToRaster(const Vector4& ndc) const
+	{
+		return { ((ndc.x + 1) / 2.0f) * m_Width, ((1.0f - ndc.y) / 2.0f) * m_Height };
+	}
+
 	//Fill screen with black
 	void Renderer::ClearBackground() const
 	{
@@ -594,87 +1947,265 @@ float dae::Renderer::CalculateTriangleArea(const Vector2& edge01, const Vector2&
 	return sqrtf(s * (s - edge01.Magnitude()) * (s - edge12.Magnitude()) * (s - edge20.Magnitude()));
 }
 
-void dae::Renderer::CreateBoundingBox(const Vector2& v0, const Vector2& v1, const Vector2& v2, Vector2& topLeft,
-	Vector2& bottomRight)const
+void dae::Renderer::CreateBoundingBox(RasterTriangle& triangle) const
 {
-	//find leftmost point 
-	topLeft = { std::min({v0.x,v1.x,v2.x}),std::min({v0.y,v1.y,v2.y}) };
-	//find rightmost point
-	bottomRight = { std::max({v0.x,v1.x,v2.x}),std::max({v0.y,v1.y,v2.y}) };
-
+	//Pixels whose center (px + 0.5) lies inside the fixed point extent of the triangle, no padding needed
+	const int fixedMinX{ std::min({ triangle.fixed0.x, triangle.fixed1.x, triangle.fixed2.x }) };
+	const int fixedMinY{ std::min({ triangle.fixed0.y, triangle.fixed1.y, triangle.fixed2.y }) };
+	const int fixedMaxX{ std::max({ triangle.fixed0.x, triangle.fixed1.x, triangle.fixed2.x }) };
+	const int fixedMaxY{ std::max({ triangle.fixed0.y, triangle.fixed1.y, triangle.fixed2.y }) };
+
+	//Shifting right floors for negative values too
+	constexpr int halfPixel{ SubPixelScale / 2 };
+	triangle.minX = std::clamp(((fixedMinX - halfPixel + SubPixelScale - 1) >> SubPixelBits), 0, m_Width);
+	triangle.minY = std::clamp(((fixedMinY - halfPixel + SubPixelScale - 1) >> SubPixelBits), 0, m_Height);
+	triangle.maxX = std::clamp(((fixedMaxX - halfPixel) >> SubPixelBits) + 1, 0, m_Width);
+	triangle.maxY = std::clamp(((fixedMaxY - halfPixel) >> SubPixelBits) + 1, 0, m_Height);
+}
 
-	topLeft.y = std::clamp(topLeft.y - 1.f, 0.f, float(m_Height) - 1.f);
-	topLeft.x = std::clamp(topLeft.x - 1.f, 0.f, float(m_Width) - 1.f);
+dae::Vector4 dae::Renderer::ToClipSpace(const Vector4& ndc)
+{
+	//w is kept through the perspective divide, so the divide can be undone
+	return { ndc.x * ndc.w, ndc.y * ndc.w, ndc.z * ndc.w, ndc.w };
+}
 
-	bottomRight.y = std::clamp(bottomRight.y + 1.f, 0.f, float(m_Height) - 1.f);
-	bottomRight.x = std::clamp(bottomRight.x + 1.f, 0.f, float(m_Width) - 1.f);
+float dae::Renderer::GetClipDistance(const Vector4& clipPosition, int plane, float extent)
+{
+	//Positive inside, planes are near, far, left, right, bottom, top
+	switch (plane)
+	{
+	case 0:
+		return clipPosition.z;
+	case 1:
+		return clipPosition.w - clipPosition.z;
+	case 2:
+		return clipPosition.x + extent * clipPosition.w;
+	case 3:
+		return extent * clipPosition.w - clipPosition.x;
+	case 4:
+		return clipPosition.y + extent * clipPosition.w;
+	default:
+		return extent * clipPosition.w - clipPosition.y;
+	}
 }
 
-bool dae::Renderer::IsInFrustum(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2) const
+int dae::Renderer::GetOutcode(const Vector4& clipPosition, float extent)
 {
-	if (v0.position.x < -1.0f || v0.position.x > 1.0f || v0.position.y < -1.0f || v0.position.y > 1.0f || v0.position.z < 0.0f || v0.position.z > 1.0f ||
-		v1.position.x < -1.0f || v1.position.x > 1.0f || v1.position.y < -1.0f || v1.position.y > 1.0f || v1.position.z < 0.0f || v1.position.z > 1.0f ||
-		v2.position.x < -1.0f || v2.position.x > 1.0f || v2.position.y < -1.0f || v2.position.y > 1.0f || v2.position.z < 0.0f || v2.position.z > 1.0f)
+	int outcode{};
+	for (int plane{}; plane < NumClipPlanes; ++plane)
 	{
-		return false;
+		//Written as !(inside) so a NaN position counts as outside
+		if (!(GetClipDistance(clipPosition, plane, extent) >= 0.f))
+			outcode |= 1 << plane;
 	}
-	return true;
+	return outcode;
 }
 
-void dae::Renderer::PixelShading(const Vertex_Out& v, int pixelIdx) const
+Vertex_Out dae::Renderer::LerpVertex(const Vertex_Out& from, const Vertex_Out& to, float t)
 {
-	bool useLinearFilter{ false };
-	if (m_pVehicleMesh->GetFilterModeName().find("Linear") != std::string::npos)
+	return
+	{
+		from.position + (to.position - from.position) * t,
+		ColorRGB::Lerp(from.color, to.color, t),
+		from.uv + (to.uv - from.uv) * t,
+		from.normal + (to.normal - from.normal) * t,
+		from.tangent + (to.tangent - from.tangent) * t,
+		from.worldPosition + (to.worldPosition - from.worldPosition) * t
+	};
+}
+
+void dae::Renderer::ClipTriangle(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2, const Vector2& raster0, const Vector2& raster1, const Vector2& raster2, int planeMask) const
+{
+	//Sutherland-Hodgman in clip space, where every attribute is still linear so the new vertices can simply lerp
+	ClipVertex polygons[2][MaxClipVertices]{};
+	ClipVertex* pInput{ polygons[0] };
+	ClipVertex* pOutput{ polygons[1] };
+
+	int numVertices{ 3 };
+	pInput[0] = { v0, ToClipSpace(v0.position), raster0, false };
+	pInput[1] = { v1, ToClipSpace(v1.position), raster1, false };
+	pInput[2] = { v2, ToClipSpace(v2.position), raster2, false };
+
+	for (int plane{}; plane < NumClipPlanes; ++plane)
+	{
+		if ((planeMask & (1 << plane)) == 0)
+			continue;
+
+		int numOutput{};
+		for (int i{}; i < numVertices; ++i)
+		{
+			const ClipVertex& current{ pInput[i] };
+			const ClipVertex& next{ pInput[(i + 1) % numVertices] };
+			const float currentDistance{ GetClipDistance(current.clipPosition, plane, GuardBand) };
+			const float nextDistance{ GetClipDistance(next.clipPosition, plane, GuardBand) };
+			const bool isCurrentInside{ currentDistance >= 0.f };
+			const bool isNextInside{ nextDistance >= 0.f };
+
+			if (isCurrentInside)
+				pOutput[numOutput++] = current;
+
+			//Always lerp from the inside vertex, so the neighbouring triangle gets the exact same vertex on the shared edge
+			const ClipVertex* pFrom{};
+			const ClipVertex* pTo{};
+			float t{};
+			if (isCurrentInside && !isNextInside)
+			{
+				pFrom = &current;
+				pTo = &next;
+				t = currentDistance / (currentDistance - nextDistance);
+			}
+			else if (!isCurrentInside && isNextInside)
+			{
+				pFrom = &next;
+				pTo = &current;
+				t = nextDistance / (nextDistance - currentDistance);
+			}
+
+			if (pFrom)
+			{
+				ClipVertex& newVertex{ pOutput[numOutput++] };
+				newVertex.vertex = LerpVertex(pFrom->vertex, pTo->vertex, t);
+				newVertex.clipPosition = pFrom->clipPosition + (pTo->clipPosition - pFrom->clipPosition) * t;
+				newVertex.isNew = true;
+			}
+		}
+
+		std::swap(pInput, pOutput);
+		numVertices = numOutput;
+		if (numVertices < 3)
+			return;
+	}
+
+	//Only the new vertices go back to NDC, the original ones keep their exact position so they can't crack against unclipped neighbours
+	//w stays for the perspective correct interpolation
+	for (int i{}; i < numVertices; ++i)
 	{
-		useLinearFilter = true;
+		ClipVertex& clipVertex{ pInput[i] };
+		if (!clipVertex.isNew)
+			continue;
+
+		const Vector4& clipPosition{ clipVertex.clipPosition };
+		clipVertex.vertex.position = { clipPosition.x / clipPosition.w, clipPosition.y / clipPosition.w, clipPosition.z / clipPosition.w, clipPosition.w };
+		clipVertex.raster = NdcToRaster(clipVertex.vertex.position);
 	}
 
-	const Vector3 lightDirection{ .577f,-.577f,.577f };
+	//The clipped polygon is convex, fan it into triangles that keep the original winding
+	for (int i{ 1 }; i + 1 < numVertices; ++i)
+	{
+		AddRasterTriangle(pInput[0].vertex, pInput[i].vertex, pInput[i + 1].vertex, pInput[0].raster, pInput[i].raster, pInput[i + 1].raster);
+	}
+}
 
+template<typename Sampler>
+const Sampler& dae::Renderer::GetSampler() const
+{
+	if constexpr (std::is_same_v<Sampler, PointWrapSampler>)
+		return m_PointSampler;
+	else if constexpr (std::is_same_v<Sampler, LinearWrapSampler>)
+		return m_LinearSampler;
+	else
+		return m_AnisotropicSampler;
+}
 
+template<dae::Renderer::LightingMode Mode, bool UseNormalMap, typename Sampler>
+void dae::Renderer::PixelShading(const Vertex_Out& v, const Vector2& uvDx, const Vector2& uvDy, int pixelIdx) const
+{
 	const float shininess{ 25.f };
-	const ColorRGB ambient{ 0.025f,0.025f,0.025f };
 
-	//Normal stuff
-	const Vector3 binormal{ Vector3::Cross(v.normal,v.tangent) };
-	const Matrix tangentSpaceAxis{ v.tangent,binormal,v.normal,{0,0,0} };
-	const ColorRGB normal{ (2.f * m_pVehicleNormalTexture->Sample(v.uv,useLinearFilter)) - ColorRGB{1.f,1.f,1.f} };
-	const Vector3 sample{ normal.r,normal.g,normal.b };
-	Vector3 sampledNormal = tangentSpaceAxis.TransformVector(sample.Normalized());
+	//Only what the mode shows gets sampled: the diffuse mode never looks at the normal, the observed area looks at nothing else
+	constexpr bool useDiffuse{ Mode == LightingMode::Diffuse || Mode == LightingMode::Combined || Mode == LightingMode::PhysicallyBased };
+	constexpr bool useSpecular{ Mode == LightingMode::Specular || Mode == LightingMode::Combined || Mode == LightingMode::PhysicallyBased };
+	constexpr bool useNormal{ Mode != LightingMode::Diffuse };
+	constexpr bool sampleNormal{ UseNormalMap && useNormal };
 
-	if (!m_UseNormalMap)
+	//All four maps in one fetch, without normal mapping the normal blocks aren't even decoded
+	MaterialSample material{};
+	if constexpr (useDiffuse || useSpecular || sampleNormal)
+		material = m_pVehicleMaterial->SampleGrad<sampleNormal>(GetSampler<Sampler>(), v.uv, uvDx, uvDy);
+
+	//Normal stuff, the sampled normal is unit length already
+	Vector3 sampledNormal{ v.normal };
+	if constexpr (sampleNormal)
 	{
-		sampledNormal = v.normal;
+		const Vector3 binormal{ Vector3::Cross(v.normal,v.tangent) };
+		const Matrix tangentSpaceAxis{ v.tangent,binormal,v.normal,{0,0,0} };
+		sampledNormal = tangentSpaceAxis.TransformVector(material.normal);
 	}
+	if constexpr (useNormal)
+		sampledNormal = FastMath::Normalize(sampledNormal);
 
-	const ColorRGB lambert{ BRDF::Lambert(1.f, m_pVehicleDiffuseTexture->Sample(v.uv,useLinearFilter)) };
-	const float phongExp{ shininess * m_pVehicleGlossinessTexture->Sample(v.uv,useLinearFilter).r };
-	const ColorRGB specular{ m_pVehicleSpecularTexture->Sample(v.uv).r * BRDF::Phong(1.0f,phongExp,lightDirection.Normalized(),v.viewDirection,sampledNormal.Normalized()) };
-	const float observedArea{ std::max(Vector3::Dot(sampledNormal.Normalized(),-lightDirection),0.0f) };
+	//Only the texture work happens per pixel here, the BRDF waits for a full batch
+	if constexpr (Mode == LightingMode::PhysicallyBased)
+	{
+		//The lanes of a batch share one light list, a pixel of another tile starts a new batch
+		PhysicallyBasedBatch& batch{ GetPhysicallyBasedBatch() };
+		const std::vector<uint32_t>* pLights{ &GetTileLights(pixelIdx) };
+		if (batch.numPixels > 0 && batch.pLights != pLights)
+			ShadePhysicallyBasedBatch(batch);
+		batch.pLights = pLights;
+
+		const int lane{ batch.numPixels++ };
+		const Vector3 toViewer{ FastMath::Normalize(m_pCamera->GetOrigin() - v.worldPosition) };
+		batch.pixelIndices[lane] = pixelIdx;
+		for (int axis{}; axis < 3; ++axis)
+		{
+			batch.normal[axis][lane] = sampledNormal[axis];
+			batch.toViewer[axis][lane] = toViewer[axis];
+			batch.worldPosition[axis][lane] = v.worldPosition[axis];
+		}
+		batch.albedo[0][lane] = material.diffuse.r;
+		batch.albedo[1][lane] = material.diffuse.g;
+		batch.albedo[2][lane] = material.diffuse.b;
+		batch.f0[lane] = material.specular;
+		batch.roughness[lane] = std::max(1.f - material.glossiness, MinRoughness);
+		batch.shadow[lane] = m_ShadowLightIdx >= 0 ? SampleShadow(v.worldPosition, v.normal) : 1.f;
+
+		if (batch.numPixels == PhysicallyBasedBatch::Size)
+			ShadePhysicallyBasedBatch(batch);
+		return;
+	}
 
+	const ColorRGB lambert{ BRDF::Lambert(1.f, material.diffuse) };
+	const float phongExp{ shininess * material.glossiness };
 
 	ColorRGB finalColor{};
 
-	const float lightIntensity{ 7.f };
-	switch (m_LightingMode)
+	if constexpr (Mode == LightingMode::Diffuse)
 	{
-	case LightingMode::ObservedArea:
-		finalColor += {observedArea, observedArea, observedArea};
-		break;
-	case LightingMode::Diffuse:
+		//Doesn't depend on the lights at all
 		finalColor += lambert;
-		break;
-	case LightingMode::Specular:
-		finalColor += specular;
-		break;
-	case LightingMode::Combined:
-		finalColor += (lightIntensity * (lambert + specular)) * observedArea;
-		break;
-	default:
-		break;
+	}
+	else
+	{
+		//From the camera to the surface, like viewDirection in VehicleShader.fx
+		const Vector3 viewDirection{ FastMath::Normalize(v.worldPosition - m_pCamera->GetOrigin()) };
+		//The debug modes show each light's term weighted by how much of it arrives, without its intensity
+		for (const uint32_t lightIdx : GetTileLights(pixelIdx))
+		{
+			const Light& light{ m_Lights[lightIdx] };
+			Vector3 toLight{};
+			float attenuation{ light.GetAttenuation(v.worldPosition, toLight) };
+			if (int(lightIdx) == m_ShadowLightIdx)
+				attenuation *= SampleShadow(v.worldPosition, v.normal);
+			if (attenuation <= 0.f)
+				continue;
+
+			const float observedArea{ std::max(Vector3::Dot(sampledNormal, toLight), 0.f) };
+			if constexpr (Mode == LightingMode::ObservedArea)
+			{
+				finalColor += light.color * (observedArea * attenuation);
+				continue;
+			}
+
+			const ColorRGB specular{ material.specular * BRDF::Phong(1.f, phongExp, -toLight, viewDirection, sampledNormal) };
+			if constexpr (Mode == LightingMode::Specular)
+				finalColor += light.color * specular * attenuation;
+			else
+				finalColor += (light.color * (light.intensity * attenuation)) * (lambert + specular) * observedArea;
+		}
 	}
 
-	finalColor += ambient;
+	finalColor += Ambient;
 	finalColor.MaxToOne();
 
 	m_pBackBufferPixels[pixelIdx] = SDL_MapRGB(m_pBackBuffer->format,
@@ -682,3 +2213,186 @@ void dae::Renderer::PixelShading(const Vertex_Out& v, int pixelIdx) const
 		static_cast<uint8_t>(finalColor.g * 255),
 		static_cast<uint8_t>(finalColor.b * 255));
 }
+
+void dae::Renderer::DepthShading(const Vertex_Out& v, const Vector2&, const Vector2&, int pixelIdx) const
+{
+	ColorRGB finalColor{ v.color };
+	finalColor.MaxToOne();
+	m_pBackBufferPixels[pixelIdx] = SDL_MapRGB(m_pBackBuffer->format,
+		static_cast<uint8_t>(finalColor.r * 255),
+		static_cast<uint8_t>(finalColor.g * 255),
+		static_cast<uint8_t>(finalColor.b * 255));
+}
+
+template<dae::Renderer::LightingMode Mode, bool UseNormalMap>
+constexpr std::array<dae::Renderer::PixelShader, 3> dae::Renderer::GetFilterPixelShaders()
+{
+	return
+	{
+		&Renderer::PixelShading<Mode, UseNormalMap, PointWrapSampler>,
+		&Renderer::PixelShading<Mode, UseNormalMap, LinearWrapSampler>,
+		&Renderer::PixelShading<Mode, UseNormalMap, AnisotropicWrapSampler>
+	};
+}
+
+dae::Renderer::PixelShader dae::Renderer::SelectPixelShader() const
+{
+	if (m_UseDepthBufferVis)
+		return &Renderer::DepthShading;
+
+	//Indexed by lighting mode, normal map and filter, in the order of their enums
+	static constexpr std::array<PixelShader, 3> pixelShaders[5][2]
+	{
+		{ GetFilterPixelShaders<LightingMode::ObservedArea, false>(), GetFilterPixelShaders<LightingMode::ObservedArea, true>() },
+		{ GetFilterPixelShaders<LightingMode::Diffuse, false>(), GetFilterPixelShaders<LightingMode::Diffuse, true>() },
+		{ GetFilterPixelShaders<LightingMode::Specular, false>(), GetFilterPixelShaders<LightingMode::Specular, true>() },
+		{ GetFilterPixelShaders<LightingMode::Combined, false>(), GetFilterPixelShaders<LightingMode::Combined, true>() },
+		{ GetFilterPixelShaders<LightingMode::PhysicallyBased, false>(), GetFilterPixelShaders<LightingMode::PhysicallyBased, true>() }
+	};
+	return pixelShaders[int(m_LightingMode)][m_UseNormalMap][int(m_pVehicleMesh->GetFilterMode())];
+}
+
+dae::Renderer::PhysicallyBasedBatch& dae::Renderer::GetPhysicallyBasedBatch()
+{
+	thread_local PhysicallyBasedBatch batch{};
+	return batch;
+}
+
+void dae::Renderer::FlushPhysicallyBasedBatch() const
+{
+	PhysicallyBasedBatch& batch{ GetPhysicallyBasedBatch() };
+	if (batch.numPixels > 0)
+		ShadePhysicallyBasedBatch(batch);
+}
+
+void dae::Renderer::ShadePhysicallyBasedBatch(PhysicallyBasedBatch& batch) const
+{
+	//A partial batch still runs full SIMD widths, the lanes past numPixels are never written out
+	float colors[3][PhysicallyBasedBatch::Size]{};
+	switch (m_SimdLevel)
+	{
+	case Simd::Level::AVX2:
+		ShadePhysicallyBasedLanes<Simd::Float8>(batch, 0, colors);
+		break;
+	case Simd::Level::SSE2:
+		for (int firstLane{}; firstLane < batch.numPixels; firstLane += Simd::Float4::Width)
+			ShadePhysicallyBasedLanes<Simd::Float4>(batch, firstLane, colors);
+		break;
+	default:
+		for (int lane{}; lane < batch.numPixels; ++lane)
+		{
+			const ColorRGB color{ ShadePhysicallyBased(batch, lane) };
+			colors[0][lane] = color.r;
+			colors[1][lane] = color.g;
+			colors[2][lane] = color.b;
+		}
+		break;
+	}
+
+	for (int lane{}; lane < batch.numPixels; ++lane)
+	{
+		ColorRGB finalColor{ colors[0][lane], colors[1][lane], colors[2][lane] };
+		finalColor.MaxToOne();
+		m_pBackBufferPixels[batch.pixelIndices[lane]] = SDL_MapRGB(m_pBackBuffer->format,
+			static_cast<uint8_t>(finalColor.r * 255),
+			static_cast<uint8_t>(finalColor.g * 255),
+			static_cast<uint8_t>(finalColor.b * 255));
+	}
+	batch.numPixels = 0;
+}
+
+template<typename SimdFloat>
+void dae::Renderer::ShadePhysicallyBasedLanes(const PhysicallyBasedBatch& batch, int firstLane, float (&colors)[3][PhysicallyBasedBatch::Size]) const
+{
+	using Float = typename SimdFloat::Float;
+	const auto load = [firstLane](const float* pRow) { return SimdFloat::Load(pRow + firstLane); };
+	const Float zero{ SimdFloat::Zero() };
+	const Float one{ SimdFloat::Set1(1.f) };
+
+	const Float n[3]{ load(batch.normal[0]), load(batch.normal[1]), load(batch.normal[2]) };
+	const Float v[3]{ load(batch.toViewer[0]), load(batch.toViewer[1]), load(batch.toViewer[2]) };
+	const Float position[3]{ load(batch.worldPosition[0]), load(batch.worldPosition[1]), load(batch.worldPosition[2]) };
+	const Float f0{ load(batch.f0) };
+	const Float roughness{ load(batch.roughness) };
+	Float albedo[3]{};
+	for (int channel{}; channel < 3; ++channel)
+		albedo[channel] = load(batch.albedo[channel]);
+
+	Float direct[3]{ zero, zero, zero };
+	for (const uint32_t lightIdx : *batch.pLights)
+	{
+		const Light& light{ m_Lights[lightIdx] };
+		Float l[3]{};
+		Float attenuation{ light.GetAttenuation<SimdFloat>(position, l) };
+		if (int(lightIdx) == m_ShadowLightIdx)
+			attenuation = SimdFloat::Mul(attenuation, load(batch.shadow));
+
+		Float fresnel{};
+		const Float specular{ BRDF::CookTorrance<SimdFloat>(n, v, l, f0, roughness, fresnel) };
+		const Float observedArea{ SimdFloat::Max(SimdFloat::Add(SimdFloat::Add(
+			SimdFloat::Mul(n[0], l[0]), SimdFloat::Mul(n[1], l[1])), SimdFloat::Mul(n[2], l[2])), zero) };
+		const Float diffuseWeight{ SimdFloat::Mul(SimdFloat::Sub(one, fresnel), SimdFloat::Set1(1.f / PI)) };
+		const Float radiance{ SimdFloat::Mul(SimdFloat::Mul(SimdFloat::Set1(light.intensity), attenuation), observedArea) };
+		const float lightColor[3]{ light.color.r, light.color.g, light.color.b };
+		for (int channel{}; channel < 3; ++channel)
+		{
+			const Float reflected{ SimdFloat::Add(SimdFloat::Mul(albedo[channel], diffuseWeight), specular) };
+			direct[channel] = SimdFloat::Add(direct[channel], SimdFloat::Mul(reflected, SimdFloat::Mul(radiance, SimdFloat::Set1(lightColor[channel]))));
+		}
+	}
+
+	//SSE2 has no gather, so the LUT is read lane by lane; it's only the ambient term
+	float nDotV[SimdFloat::Width]{};
+	float ambientSpecularLanes[SimdFloat::Width]{};
+	SimdFloat::Store(nDotV, SimdFloat::Add(SimdFloat::Add(SimdFloat::Mul(n[0], v[0]), SimdFloat::Mul(n[1], v[1])), SimdFloat::Mul(n[2], v[2])));
+	for (int lane{}; lane < SimdFloat::Width; ++lane)
+	{
+		const Vector2 environmentBRDF{ m_pSplitSumLut->Sample(nDotV[lane], batch.roughness[firstLane + lane]) };
+		ambientSpecularLanes[lane] = batch.f0[firstLane + lane] * environmentBRDF.x + environmentBRDF.y;
+	}
+	const Float ambientSpecular{ SimdFloat::Load(ambientSpecularLanes) };
+	const Float ambientDiffuseWeight{ SimdFloat::Sub(one, ambientSpecular) };
+
+	const float ambient[3]{ Ambient.r, Ambient.g, Ambient.b };
+	for (int channel{}; channel < 3; ++channel)
+	{
+		const Float indirect{ SimdFloat::Mul(SimdFloat::Set1(ambient[channel]), SimdFloat::Add(SimdFloat::Mul(albedo[channel], ambientDiffuseWeight), ambientSpecular)) };
+		SimdFloat::Store(colors[channel] + firstLane, SimdFloat::Add(direct[channel], indirect));
+	}
+}
+
+dae::ColorRGB dae::Renderer::ShadePhysicallyBased(const PhysicallyBasedBatch& batch, int lane) const
+{
+	const Vector3 n{ batch.normal[0][lane], batch.normal[1][lane], batch.normal[2][lane] };
+	const Vector3 v{ batch.toViewer[0][lane], batch.toViewer[1][lane], batch.toViewer[2][lane] };
+	const Vector3 position{ batch.worldPosition[0][lane], batch.worldPosition[1][lane], batch.worldPosition[2][lane] };
+	const ColorRGB albedo{ batch.albedo[0][lane], batch.albedo[1][lane], batch.albedo[2][lane] };
+	const ColorRGB f0{ batch.f0[lane], batch.f0[lane], batch.f0[lane] };
+	const float roughness{ batch.roughness[lane] };
+	const ColorRGB one{ 1.f, 1.f, 1.f };
+
+	ColorRGB direct{};
+	for (const uint32_t lightIdx : *batch.pLights)
+	{
+		const Light& light{ m_Lights[lightIdx] };
+		Vector3 l{};
+		float attenuation{ light.GetAttenuation(position, l) };
+		if (int(lightIdx) == m_ShadowLightIdx)
+			attenuation *= batch.shadow[lane];
+		if (attenuation <= 0.f)
+			continue;
+
+		ColorRGB fresnel{};
+		const ColorRGB specular{ BRDF::CookTorrance(n, v, l, f0, roughness, fresnel) };
+		//Whatever the surface reflects doesn't make it into the diffuse part
+		const ColorRGB diffuse{ BRDF::Lambert(one - fresnel, albedo) };
+		const float observedArea{ std::max(Vector3::Dot(n, l), 0.f) };
+		direct += light.color * (light.intensity * attenuation * observedArea) * (diffuse + specular);
+	}
+
+	//Split sum: the environment is the uniform ambient light, the LUT holds how much of it the lobe reflects
+	const Vector2 environmentBRDF{ m_pSplitSumLut->Sample(Vector3::Dot(n, v), roughness) };
+	const ColorRGB ambientSpecular{ f0 * environmentBRDF.x + ColorRGB{ environmentBRDF.y, environmentBRDF.y, environmentBRDF.y } };
+
+	return direct + Ambient * (albedo * (one - ambientSpecular) + ambientSpecular);
+}
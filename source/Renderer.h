@@ -1,8 +1,14 @@
 #pragma once
 #include "Mesh.h"
+#include "MaterialTextureSet.h"
 #include "VehicleEffect.h"
 #include "Camera.h"
 #include "FireEffect.h"
+#include "ThreadPool.h"
+#include "FrameArena.h"
+#include "Simd.h"
+#include "SplitSumLut.h"
+#include "Light.h"
 struct SDL_Window;
 struct SDL_Surface;
 class Mesh;
@@ -16,7 +22,9 @@ namespace dae
 			ObservedArea,
 			Diffuse,
 			Specular,
-			Combined
+			Combined,
+			//Cook-Torrance with GGX, the glossiness map drives the roughness and the specular map f0
+			PhysicallyBased
 		};
 
 
@@ -28,6 +36,9 @@ namespace dae
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
+		//False when DirectX or loading the resources failed, the renderer then draws nothing
+		bool IsInitialized() const { return m_IsInitialized; }
+
 		void Update(const Timer* pTimer);
 		void Render() const;
 		void RenderDX() const;
@@ -56,6 +67,31 @@ namespace dae
 		bool GetUseDepthBufferVis() const { return m_UseDepthBufferVis; }
 		void ToggleBBVis() { m_UseBBVis = !m_UseBBVis; }
 		bool GetUseBBVis() const { return m_UseBBVis; }
+		void ToggleTiledRendering() { m_UseTiledRendering = !m_UseTiledRendering; }
+		bool GetUseTiledRendering() const { return m_UseTiledRendering; }
+		void CycleSimdLevel();
+		Simd::Level GetSimdLevel() const { return m_SimdLevel; }
+		void ToggleDeferredShading() { m_UseDeferredShading = !m_UseDeferredShading; }
+		bool GetUseDeferredShading() const { return m_UseDeferredShading; }
+		void ToggleShadows() { m_UseShadows = !m_UseShadows; }
+		bool GetUseShadows() const { return m_UseShadows; }
+		//Stays the same from frame to frame once the software path has warmed up
+		uint32_t GetFrameArenaHeapAllocations() const { return m_pFrameArena->GetNumHeapAllocations(); }
+		size_t GetFrameArenaCapacity() const { return m_pFrameArena->GetCapacity(); }
+		//Bytes of CPU texel data kept in memory, finer mip levels are streamed in and out to stay below it
+		void SetTextureBudget(size_t budgetInBytes) { m_pTextureResidency->SetBudget(budgetInBytes); }
+		size_t GetTextureBudget() const { return m_pTextureResidency->GetBudget(); }
+
+		// Lights
+		//Both paths start out with the one directional light their shaders used to hard-code
+		void AddLight(const Light& light) { m_Lights.emplace_back(light); }
+		void ClearLights() { m_Lights.clear(); }
+		std::vector<Light>& GetLights() { return m_Lights; }
+		const std::vector<Light>& GetLights() const { return m_Lights; }
+		//Lights every screen tile of the last software frame evaluated, directional ones included; row by row, GetNumTilesX() per row
+		std::vector<uint32_t> GetTileLightCounts() const;
+		int GetNumTilesX() const { return m_NumTilesX; }
+		int GetNumTilesY() const { return m_NumTilesY; }
 
 
 
@@ -74,6 +110,19 @@ namespace dae
 		Texture* m_pVehicleSpecularTexture{};
 		Texture* m_pVehicleGlossinessTexture{};
 		Texture* m_pFireDiffuseTexture{};
+		//The four vehicle maps interleaved for the software path, so shading fetches them with one lookup
+		MaterialTextureSet* m_pVehicleMaterial{};
+		//Pages the CPU mip levels of the material set in and out, updated at the start of every software frame
+		//The separate textures above keep no CPU copy, only D3D samples them
+		TextureResidency* m_pTextureResidency{};
+		//Just holds the full material set, a scene with more or larger materials streams within it
+		static constexpr size_t DefaultTextureBudget{ 4 * 1024 * 1024 };
+		//Ambient response of the physically based mode, built on the workers during loading
+		SplitSumLut* m_pSplitSumLut{};
+		//Same states as samPoint, samLinear and samAnisotropic in VehicleShader.fx
+		PointWrapSampler m_PointSampler{};
+		LinearWrapSampler m_LinearSampler{};
+		AnisotropicWrapSampler m_AnisotropicSampler{};
 
 		// ---Effects---
 		VehicleEffect* m_pVehicleEffect{};
@@ -83,6 +132,8 @@ namespace dae
 		Mesh* m_pFireMesh{};
 
 		std::vector<Mesh*> m_pMeshes;
+		//FireFX needs alpha blending, so only the DirectX path draws it
+		std::vector<Mesh*> m_pSoftwareMeshes;
 
 		bool m_IsInitialized{ false };
 
@@ -102,24 +153,292 @@ namespace dae
 		SDL_Surface* m_pBackBuffer{ nullptr };
 		uint32_t* m_pBackBufferPixels{};
 		float* m_pDepthBufferPixels{};
+		//Deferred mode: index + 1 of the RasterTriangle that is visible in each pixel, 0 where nothing was drawn
+		uint32_t* m_pVisibilityBufferPixels{};
+
+		//Post-transform data of a software mesh in structure-of-arrays form, lives in m_pFrameArena until the next frame
+		//uv and view direction don't change during the transform, those are read from the mesh's VertexStreams
+		struct TransformedMesh
+		{
+			size_t numVertices{};
+			//NDC x, y and z, w stays in clip space for the perspective correct interpolation
+			float* pPositionX{};
+			float* pPositionY{};
+			float* pPositionZ{};
+			float* pPositionW{};
+			float* pRasterX{};
+			float* pRasterY{};
+			//World space
+			float* pNormalX{};
+			float* pNormalY{};
+			float* pNormalZ{};
+			float* pTangentX{};
+			float* pTangentY{};
+			float* pTangentZ{};
+			float* pWorldPositionX{};
+			float* pWorldPositionY{};
+			float* pWorldPositionZ{};
+			//Shadow map texels and depth, only filled in on frames that render a shadow map
+			float* pShadowX{};
+			float* pShadowY{};
+			float* pShadowDepth{};
+
+			Matrix world{};
+			Matrix worldViewProjection{};
+			Matrix worldShadow{};
+
+			static constexpr int NumStreams{ 18 };
+		};
+		FrameArena* m_pFrameArena{};
+		mutable std::vector<TransformedMesh> m_TransformedMeshes{};
+
+		//Vertex ranges the thread pool transforms in parallel, the triangle setup picks them up in order as soon as they are done
+		//A multiple of 8 so every chunk starts on a full SIMD batch
+		static constexpr size_t VertexChunkSize{ 1024 };
+		struct VertexChunk
+		{
+			uint32_t meshIdx{};
+			size_t begin{};
+			size_t end{};
+		};
+		std::vector<VertexChunk> m_VertexChunks{};
+		//First chunk of every software mesh, the chunks of a mesh are contiguous
+		std::vector<uint32_t> m_FirstVertexChunks{};
+		mutable std::vector<std::atomic<bool>> m_IsVertexChunkDone{};
+
+		//Screen-space triangle that survived culling, set up once per frame and shared by every tile it touches
+		struct RasterTriangle
+		{
+			Vertex_Out v0{};
+			Vertex_Out v1{};
+			Vertex_Out v2{};
+
+			//Screen-space vertex coordinates in 28.4 fixed point
+			Int2 fixed0{};
+			Int2 fixed1{};
+			Int2 fixed2{};
+
+			//Twice the signed screen-space area in fixed point units, always positive for triangles that get drawn
+			int64_t doubleArea{};
+
+			//No pixel of the triangle can end up with a smaller depth buffer value than this
+			float minDepth{};
+
+			//Screen-space gradients of uv / w and 1 / w (with the half-sum weights), for the analytic uv derivatives that pick the mip level
+			Vector2 uvOverWDx{};
+			Vector2 uvOverWDy{};
+			float invWDx{};
+			float invWDy{};
+
+			//Pixel bounds, max is exclusive
+			int minX{};
+			int minY{};
+			int maxX{};
+			int maxY{};
+		};
+
+		//Edge function E(px, py) = origin + stepX * px + stepY * py, evaluated at pixel centers in fixed point
+		struct EdgeFunction
+		{
+			int64_t origin{};
+			int64_t stepX{};
+			int64_t stepY{};
+			//1 on top and left edges, a pixel center exactly on a shared edge then belongs to exactly one of the triangles
+			int64_t bias{};
+
+			int64_t RowValue(int py) const { return origin + stepY * py; }
+		};
+
+		static constexpr int SubPixelBits{ 4 };
+		static constexpr int SubPixelScale{ 1 << SubPixelBits };
+
+		static constexpr int TileSize{ 64 };
+		int m_NumTilesX{};
+		int m_NumTilesY{};
+
+		ThreadPool* m_pThreadPool{};
+		//Per-frame scratch, cleared but never shrunk so steady frames reuse the same memory
+		mutable std::vector<RasterTriangle> m_RasterTriangles{};
+		mutable std::vector<std::vector<uint32_t>> m_TileBins{};
+
+		std::vector<Light> m_Lights{};
+		//Indices of the lights that can reach a pixel of each tile, rebuilt every frame before any tile is shaded
+		mutable std::vector<std::vector<uint32_t>> m_TileLights{};
+
+		//Hierarchical depth: max depth per 8x8 block and per tile, a triangle behind that max can't pass a single depth test there
+		static constexpr int HiZBlockSize{ 8 };
+		int m_NumHiZBlocksX{};
+		int m_NumHiZBlocksY{};
+		mutable std::vector<float> m_HiZBlocks{};
+		mutable std::vector<float> m_HiZTiles{};
+		//Blocks the current triangle drew into, their max is recomputed once the triangle is done
+		mutable std::vector<uint8_t> m_HiZDirty{};
+
+		//Depth from the shadow casting light, orthographic around the software meshes so every caster is inside; 0 is closest to the light
+		//Rendered in tiles of TileSize texels like the frame itself, but only depth is written
+		static constexpr int ShadowMapSize{ 1024 };
+		static constexpr int NumShadowTiles{ ShadowMapSize / TileSize };
+		float* m_pShadowMapPixels{};
+		//World space to shadow map texels in x and y and depth in z
+		mutable Matrix m_ShadowMatrix{};
+		mutable float m_ShadowTexelSize{};
+		//Index of the light the shadow map belongs to, -1 on frames that have none
+		mutable int m_ShadowLightIdx{ -1 };
+		//Receivers are moved this many texels along their normal and towards the light before the compare, so lit surfaces don't shadow themselves
+		static constexpr float ShadowNormalOffset{ 1.5f };
+		static constexpr float ShadowDepthBias{ 1.f };
+
+		//Caster triangle in shadow map space, no attributes at all
+		struct ShadowTriangle
+		{
+			Int2 fixed0{};
+			Int2 fixed1{};
+			Int2 fixed2{};
+			int64_t doubleArea{};
+
+			//Orthographic depth is affine in the map, so it's a plane through the depth at the center of texel (minX, minY)
+			float depth{};
+			float depthDx{};
+			float depthDy{};
+
+			int minX{};
+			int minY{};
+			int maxX{};
+			int maxY{};
+		};
+		mutable std::vector<ShadowTriangle> m_ShadowTriangles{};
+		mutable std::vector<std::vector<uint32_t>> m_ShadowTileBins{};
 
 
 		void ClearBackground() const;
 		void DestructDx();
 		void DestructSoftware();
 
-		void VertexTransformationFunction(const std::vector<Mesh*>& mesh_in) const;
-		void ConvertToRaster(const std::vector<Mesh*>& meshes, std::vector<Vector2>& rasterVerts) const;
+		void PrepareTransformedMeshes(const std::vector<Mesh*>& meshes) const;
+		void TransformVertexChunk(uint32_t chunkIdx) const;
+		void WaitForVertexChunk(ThreadPool::Batch& batch, uint32_t chunkIdx) const;
+		template<typename SimdFloat>
+		void TransformVertices(const VertexStreams& input, const TransformedMesh& output, size_t begin, size_t end) const;
+		static Vertex_Out GatherVertex(const VertexStreams& input, const TransformedMesh& transformed, uint32_t vertexIdx);
 
 		float CalculateTriangleArea(const Vector2& edge01, const Vector2& edge12, const Vector2& edge20) const;
-		void CreateBoundingBox(const Vector2& v0, const Vector2& v1, const Vector2& v2, Vector2& topLeft, Vector2& bottomRight) const;
-		bool IsInFrustum(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2) const;
-
-		void PixelShading(const Vertex_Out& v, int pixelIdx) const;
+		void CreateBoundingBox(RasterTriangle& triangle) const;
+		Vector2 NdcToRaster(const Vector4& ndc) const;
+
+		//x and y are only clipped against a guard band around the viewport, the bounding box takes care of the rest
+		static constexpr float GuardBand{ 2.f };
+		static constexpr int NumClipPlanes{ 6 };
+		//Every plane can add at most one vertex to the polygon
+		static constexpr int MaxClipVertices{ 3 + NumClipPlanes };
+		static Vector4 ToClipSpace(const Vector4& ndc);
+		static float GetClipDistance(const Vector4& clipPosition, int plane, float extent);
+		static int GetOutcode(const Vector4& clipPosition, float extent);
+		static Vertex_Out LerpVertex(const Vertex_Out& from, const Vertex_Out& to, float t);
+		//Polygon vertex during clipping, vertices of the input triangle keep their exact NDC and raster position
+		struct ClipVertex
+		{
+			Vertex_Out vertex{};
+			Vector4 clipPosition{};
+			Vector2 raster{};
+			bool isNew{};
+		};
+		void ClipTriangle(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2, const Vector2& raster0, const Vector2& raster1, const Vector2& raster2, int planeMask) const;
+		void AddRasterTriangle(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2, const Vector2& raster0, const Vector2& raster1, const Vector2& raster2) const;
+
+		void SetupTriangles(const std::vector<Mesh*>& meshes, ThreadPool::Batch& vertexBatch) const;
+
+		//Picks the shadow casting light and fits m_ShadowMatrix around the meshes, false when this frame needs no shadow map
+		bool PrepareShadowMap(const std::vector<Mesh*>& meshes) const;
+		void RenderShadowMap(const std::vector<Mesh*>& meshes) const;
+		void SetupShadowTriangles(const std::vector<Mesh*>& meshes) const;
+		void AddShadowTriangle(const Vector3& shadow0, const Vector3& shadow1, const Vector3& shadow2) const;
+		void RasterizeShadowTriangle(uint32_t triangleIdx, int clipMinX, int clipMinY, int clipMaxX, int clipMaxY) const;
+		void RasterizeShadowTriangleScalar(const ShadowTriangle& triangle, const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20,
+			int minX, int minY, int maxX, int maxY) const;
+		template<typename SimdFloat>
+		void RasterizeShadowTriangleSimd(const ShadowTriangle& triangle, const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20,
+			int minX, int minY, int maxX, int maxY) const;
+		static float GetShadowDepth(const ShadowTriangle& triangle, int px, int py);
+		//Share of the shadow casting light that reaches a surface point, 3x3 bilinear PCF
+		float SampleShadow(const Vector3& worldPosition, const Vector3& normal) const;
+		void BinTriangles() const;
+		void BinLights() const;
+		//Tiles a point or spot light's range overlaps on screen, false when it's all outside the view
+		bool FindLightTiles(const Light& light, const Matrix& viewProjection, int& firstTileX, int& firstTileY, int& lastTileX, int& lastTileY) const;
+		const std::vector<uint32_t>& GetTileLights(int pixelIdx) const;
+		void RenderTiles() const;
+		void RasterizeTriangle(uint32_t triangleIdx, int clipMinX, int clipMinY, int clipMaxX, int clipMaxY) const;
+		void RasterizeTriangleScalar(uint32_t triangleIdx, const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20,
+			int minX, int minY, int maxX, int maxY) const;
+		template<typename SimdFloat>
+		void RasterizeTriangleSimd(uint32_t triangleIdx, const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20,
+			int minX, int minY, int maxX, int maxY) const;
+		static EdgeFunction SetupEdge(const Int2& from, const Int2& to);
+		static bool FitsInt32Lanes(const EdgeFunction& edge, int minX, int minY, int maxX, int maxY);
+		static bool FindSpan(const EdgeFunction& edge01, const EdgeFunction& edge12, const EdgeFunction& edge20, int py, int& spanStart, int& spanEnd);
+		static bool NarrowSpan(int64_t rowValue, int64_t step, int64_t& spanStart, int64_t& spanEnd);
+		static bool IsCovered(const RasterTriangle& triangle, int px, int py);
+
+		void ClearHiZ() const;
+		bool IsOccluded(float minDepth, int minX, int minY, int maxX, int maxY) const;
+		bool NextHiZSegment(float minDepth, int py, int segmentStart, int spanEnd, int& segmentEnd) const;
+		void UpdateHiZ(int minX, int minY, int maxX, int maxY) const;
+		static float InterpolateDepth(const RasterTriangle& triangle, float weightV0, float weightV1, float weightV2);
+		void ShadeFragment(const RasterTriangle& triangle, float weightV0, float weightV1, float weightV2, int pixelIdx) const;
+		void InterpolateFragment(const RasterTriangle& triangle, float interpolatedZ, float weightV0, float weightV1, float weightV2, int pixelIdx) const;
+		void WriteVisibility(uint32_t triangleIdx, float weightV0, float weightV1, float weightV2, int pixelIdx) const;
+		void ShadeVisibilityBuffer(int minX, int minY, int maxX, int maxY) const;
+		void WriteFragment(float interpolatedZ, const Vector2& interpolatedUV, const Vector2& uvDx, const Vector2& uvDy, const Vector3& interpolatedNormal, const Vector3& interpolatedTangent, const Vector3& interpolatedWorldPosition, int pixelIdx) const;
+
+		//Every lighting mode, normal map setting and sampler compiles into its own pixel shader, like the techniques of VehicleShader.fx
+		//RenderSoftware picks one per frame, so shading a pixel checks no modes
+		using PixelShader = void (Renderer::*)(const Vertex_Out& v, const Vector2& uvDx, const Vector2& uvDy, int pixelIdx) const;
+		template<LightingMode Mode, bool UseNormalMap, typename Sampler>
+		void PixelShading(const Vertex_Out& v, const Vector2& uvDx, const Vector2& uvDy, int pixelIdx) const;
+		//Depth buffer visualization, the remapped depth comes in as the vertex color
+		void DepthShading(const Vertex_Out& v, const Vector2& uvDx, const Vector2& uvDy, int pixelIdx) const;
+		PixelShader SelectPixelShader() const;
+
+		//Inputs of physically based pixels, the pixel shader collects them and the BRDF runs once per full batch with one pixel per SIMD lane
+		//A batch belongs to a thread, and every tile flushes its own before it's done
+		struct PhysicallyBasedBatch
+		{
+			static constexpr int Size{ 8 };
+			int numPixels{};
+			int pixelIndices[Size]{};
+			//Rows of lanes, so a SIMD load reads straight from them
+			float normal[3][Size]{};
+			float toViewer[3][Size]{};
+			float albedo[3][Size]{};
+			float f0[Size]{};
+			float roughness[Size]{};
+			float worldPosition[3][Size]{};
+			//SampleShadow of every pixel, applied to the shadow casting light only
+			float shadow[Size]{};
+			//Every pixel of a batch comes from the same tile, so they all see the same lights
+			const std::vector<uint32_t>* pLights{};
+		};
+		static PhysicallyBasedBatch& GetPhysicallyBasedBatch();
+		void FlushPhysicallyBasedBatch() const;
+		void ShadePhysicallyBasedBatch(PhysicallyBasedBatch& batch) const;
+		template<typename SimdFloat>
+		void ShadePhysicallyBasedLanes(const PhysicallyBasedBatch& batch, int firstLane, float (&colors)[3][PhysicallyBasedBatch::Size]) const;
+		ColorRGB ShadePhysicallyBased(const PhysicallyBasedBatch& batch, int lane) const;
+		//The pixel shaders of one lighting mode and normal map setting, in the order of Mesh::FilteringTechnique
+		template<LightingMode Mode, bool UseNormalMap>
+		static constexpr std::array<PixelShader, 3> GetFilterPixelShaders();
+		template<typename Sampler>
+		const Sampler& GetSampler() const;
+		mutable PixelShader m_pPixelShader{};
 
 		bool m_UseNormalMap{ true };
 		bool m_UseDepthBufferVis{ false };
 		bool m_UseBBVis{ false };
+		bool m_UseTiledRendering{ true };
+		bool m_UseDeferredShading{ false };
+		bool m_UseShadows{ true };
+		Simd::Level m_SimdLevel{ Simd::Level::Scalar };
+		Simd::Level m_MaxSimdLevel{ Simd::Level::Scalar };
 
 
 
@@ -58,12 +58,23 @@ DepthStencilState gDepthStencilState
 };
 
 // Extra Variables
-float3 gLightDirection = {0.577f,-0.577f,0.577f};
 float1 gPI = 3.14159265359f;
 float3 gAmbient = {0.025f,0.025f,0.025f};
-float1 gLightIntensity = 7.0f;
 float1 gShininess = 25.0f;
 
+// Lights, filled in by VehicleEffect::SetLights from the renderer's light list
+// Same limit as VehicleEffect::MaxLights, every pixel loops over all of them
+#define MAX_LIGHTS 16
+int gNumLights = 0;
+// xyz position, w the type: 0 directional, 1 point, 2 spot
+float4 gLightPositions[MAX_LIGHTS];
+// xyz direction the light travels, w range
+float4 gLightDirections[MAX_LIGHTS];
+// rgb color, a intensity
+float4 gLightColors[MAX_LIGHTS];
+// x cosine of the inner cone angle, y of the outer one
+float4 gLightCones[MAX_LIGHTS];
+
 SamplerState samPoint
 {
     Filter = MIN_MAG_MIP_POINT;
@@ -115,6 +126,13 @@ VS_OUTPUT VS(VS_INPUT input)
     return output;
 }
 
+//The normal map is BC5, which only stores x and y; z follows from the normal being unit length
+float3 DecodeNormal(float2 encoded)
+{
+	float2 xy = 2.f * encoded - float2(1.f,1.f);
+	return float3(xy, sqrt(saturate(1.f - dot(xy,xy))));
+}
+
 float4 Lambert(float kd, float4 cd)
 {
 	return cd * kd / gPI;
@@ -129,6 +147,46 @@ float Phong(float ks, float exp,  float3 l,  float3 v,  float3 n)
 	return specular;
 }
 
+// Share of the light's intensity that reaches worldPosition, the same falloff as Light::GetAttenuation on the software path
+float GetAttenuation(int lightIdx, float3 worldPosition, out float3 toLight)
+{
+	float4 position = gLightPositions[lightIdx];
+	float4 direction = gLightDirections[lightIdx];
+	if (position.w == 0.f)
+	{
+		toLight = -direction.xyz;
+		return 1.f;
+	}
+
+	float3 offset = position.xyz - worldPosition;
+	float distanceSquared = max(dot(offset,offset), 1e-8f);
+	toLight = offset * rsqrt(distanceSquared);
+	float falloff = saturate(1.f - distanceSquared / (direction.w * direction.w));
+	float attenuation = falloff * falloff;
+	if (position.w == 2.f)
+	{
+		float2 cone = gLightCones[lightIdx].xy;
+		float spot = saturate((dot(-direction.xyz,toLight) - cone.y) / max(cone.x - cone.y, 1e-4f));
+		attenuation *= spot * spot;
+	}
+	return attenuation;
+}
+
+float4 Shade(float3 worldPosition, float3 viewDirection, float3 normal, float4 lambert, float4 specularColor, float phongExp)
+{
+	float4 color = float4(gAmbient,.025f);
+	for (int lightIdx = 0; lightIdx < gNumLights; ++lightIdx)
+	{
+		float3 toLight;
+		float attenuation = GetAttenuation(lightIdx, worldPosition, toLight);
+		float4 specular = specularColor * Phong(1.0f,phongExp,toLight,viewDirection,normal);
+		float observedArea = saturate(dot(normal,toLight));
+		float4 lightColor = gLightColors[lightIdx];
+		color += (lightColor.a * lambert + specular) * float4(lightColor.rgb,1.f) * (attenuation * observedArea);
+	}
+	return color;
+}
+
 // Pixel Shader Point
 float4 PSPoint(VS_OUTPUT input) : SV_TARGET
 {
@@ -140,16 +198,15 @@ float4 PSPoint(VS_OUTPUT input) : SV_TARGET
                                         float4(input.Normal, 0.0), 
                                         float4(0.0f, 0.0f, 0.0f, 1.0f));
 
-	float3 normal = (2.f * gNormalMap.Sample(samPoint,input.UV).rgb) - float3(1.f,1.f,1.f);
+	float3 normal = DecodeNormal(gNormalMap.Sample(samPoint,input.UV).rg);
 	float3 sampledNormal = mul(float4(normal,0),tangentSpaceAxis);
 
 	float4 lambert = Lambert(1.f, gDiffuseMap.Sample(samPoint,input.UV));
 	float phongExp = gShininess * gGlossinessMap.Sample(samPoint,input.UV).r;
-	float4 specular = gSpecularMap.Sample(samPoint,input.UV) *  Phong(1.0f,phongExp,-normalize(gLightDirection),viewDirection,normalize(sampledNormal));
-	float observedArea =  saturate(dot(normalize(sampledNormal),-normalize(gLightDirection)));
+	float4 specularColor = gSpecularMap.Sample(samPoint,input.UV);
 	
 	
-    return ((gLightIntensity * lambert  + specular)* observedArea) + float4(gAmbient,.025f);
+    return Shade(input.WorldPosition.xyz,viewDirection,normalize(sampledNormal),lambert,specularColor,phongExp);
     //return float4(input.Color,1.f);
  
 
@@ -168,16 +225,15 @@ float4 PSLinear(VS_OUTPUT input) : SV_TARGET
                                         float4(input.Normal, 0.0), 
                                         float4(0.0f, 0.0f, 0.0f, 1.0f));
 
-	float3 normal = (2.f * gNormalMap.Sample(samLinear,input.UV).rgb) - float3(1.f,1.f,1.f);
+	float3 normal = DecodeNormal(gNormalMap.Sample(samLinear,input.UV).rg);
 	float3 sampledNormal = mul(float4(normal,0),tangentSpaceAxis);
 
 	float4 lambert = Lambert(1.f, gDiffuseMap.Sample(samLinear,input.UV));
 	float phongExp = gShininess * gGlossinessMap.Sample(samLinear,input.UV).r;
-	float4 specular = gSpecularMap.Sample(samLinear,input.UV) *  Phong(1.0f,phongExp,-normalize(gLightDirection),viewDirection,normalize(sampledNormal));
-	float observedArea =  saturate(dot(normalize(sampledNormal),-normalize(gLightDirection)));
+	float4 specularColor = gSpecularMap.Sample(samLinear,input.UV);
 	
 	
-    return ((gLightIntensity * lambert  + specular)* observedArea) + float4(gAmbient,.025f);
+    return Shade(input.WorldPosition.xyz,viewDirection,normalize(sampledNormal),lambert,specularColor,phongExp);
 }
 
 // Pixel Shader Anisotropic
@@ -191,16 +247,15 @@ float4 PSAnisotropic(VS_OUTPUT input) : SV_TARGET
                                         float4(input.Normal, 0.0), 
                                         float4(0.0f, 0.0f, 0.0f, 1.0f));
 
-	float3 normal = (2.f * gNormalMap.Sample(samAnisotropic,input.UV).rgb) - float3(1.f,1.f,1.f);
+	float3 normal = DecodeNormal(gNormalMap.Sample(samAnisotropic,input.UV).rg);
 	float3 sampledNormal = mul(float4(normal,0),tangentSpaceAxis);
 
 	float4 lambert = Lambert(1.f, gDiffuseMap.Sample(samAnisotropic,input.UV));
 	float phongExp = gShininess * gGlossinessMap.Sample(samAnisotropic,input.UV).r;
-	float4 specular = gSpecularMap.Sample(samAnisotropic,input.UV) *  Phong(1.0f,phongExp,-normalize(gLightDirection),viewDirection,normalize(sampledNormal));
-	float observedArea =  saturate(dot(normalize(sampledNormal),-normalize(gLightDirection)));
+	float4 specularColor = gSpecularMap.Sample(samAnisotropic,input.UV);
 	
 	
-    return ((gLightIntensity * lambert  + specular)* observedArea) + float4(gAmbient,.025f);
+    return Shade(input.WorldPosition.xyz,viewDirection,normalize(sampledNormal),lambert,specularColor,phongExp);
 }
 
 // Techniques
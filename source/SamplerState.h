@@ -0,0 +1,90 @@
+#pragma once
+#include "Math.h"
+#include <algorithm>
+#include <cmath>
+
+enum class TextureFilter
+{
+	Point,
+	Linear,
+	//Several trilinear probes along the longer axis of the pixel footprint
+	Anisotropic
+};
+
+//Same meaning as the AddressU/AddressV values of an .fx SamplerState
+enum class TextureAddressMode
+{
+	Wrap,
+	Mirror,
+	Clamp,
+	Border
+};
+
+//CPU counterpart of an .fx SamplerState
+//Filter and address modes are template parameters, so every combination compiles into its own sampling code without per-texel branches
+template<TextureFilter Filter, TextureAddressMode AddressU = TextureAddressMode::Wrap, TextureAddressMode AddressV = AddressU>
+struct SamplerState
+{
+	static constexpr TextureFilter filter{ Filter };
+	static constexpr TextureAddressMode addressU{ AddressU };
+	static constexpr TextureAddressMode addressV{ AddressV };
+	static constexpr bool hasBorder{ AddressU == TextureAddressMode::Border || AddressV == TextureAddressMode::Border };
+
+	//Only read with Border addressing, white like the D3D11 default
+	dae::ColorRGB borderColor{ 1.f, 1.f, 1.f };
+	//Only read with Anisotropic filtering, upper limit for the number of probes per sample; 16 is the D3D11 default
+	int maxAnisotropy{ 16 };
+
+	//The border color as an RGBA8 texel with red in the lowest byte, so it can stand in for a fetched texel
+	uint32_t GetBorderTexel() const
+	{
+		const auto toUnorm = [](float channel) { return uint32_t(std::clamp(channel, 0.f, 1.f) * 255.f + 0.5f); };
+		return toUnorm(borderColor.r) | (toUnorm(borderColor.g) << 8) | (toUnorm(borderColor.b) << 16) | 0xFF000000;
+	}
+};
+
+//The samplers of VehicleShader.fx
+using PointWrapSampler = SamplerState<TextureFilter::Point>;
+using LinearWrapSampler = SamplerState<TextureFilter::Linear>;
+using AnisotropicWrapSampler = SamplerState<TextureFilter::Anisotropic>;
+
+//Integer texel coordinate below the texture coordinate, also for negative uvs where a cast would round the wrong way
+inline int FloorToTexel(float coordinate)
+{
+	return int(std::floor(coordinate));
+}
+
+//Maps any texel coordinate into [0, size), Border returns -1 for coordinates outside so the caller uses the border color
+template<TextureAddressMode Mode>
+int AddressTexel(int coordinate, int size)
+{
+	//Most coordinates are inside already, the divide is only paid at the edges and for repeating uvs
+	const bool isInside{ uint32_t(coordinate) < uint32_t(size) };
+
+	if constexpr (Mode == TextureAddressMode::Wrap)
+	{
+		if (isInside)
+			return coordinate;
+		const int wrapped{ coordinate % size };
+		return wrapped < 0 ? wrapped + size : wrapped;
+	}
+	else if constexpr (Mode == TextureAddressMode::Mirror)
+	{
+		if (isInside)
+			return coordinate;
+		//Every other repetition is flipped, so one period covers twice the size
+		const int period{ 2 * size };
+		int mirrored{ coordinate % period };
+		if (mirrored < 0)
+			mirrored += period;
+		return mirrored < size ? mirrored : period - 1 - mirrored;
+	}
+	else if constexpr (Mode == TextureAddressMode::Clamp)
+	{
+		return std::clamp(coordinate, 0, size - 1);
+	}
+	else
+	{
+		return isInside ? coordinate : -1;
+	}
+}
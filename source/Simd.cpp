@@ -0,0 +1,48 @@
+#include "pch.h"
+#include "Simd.h"
+#include <intrin.h>
+
+namespace dae
+{
+	namespace Simd
+	{
+		Level GetBestSupportedLevel()
+		{
+			int cpuInfo[4]{};
+
+			__cpuid(cpuInfo, 0);
+			const int highestLeaf{ cpuInfo[0] };
+			if (highestLeaf < 7)
+				return Level::SSE2;
+
+			//AVX needs both the CPU flag and the OS to save the ymm registers on context switches (OSXSAVE + XCR0)
+			__cpuid(cpuInfo, 1);
+			const bool hasOsxsave{ (cpuInfo[2] & (1 << 27)) != 0 };
+			const bool hasAvx{ (cpuInfo[2] & (1 << 28)) != 0 };
+			if (!hasOsxsave || !hasAvx)
+				return Level::SSE2;
+
+			if ((_xgetbv(0) & 0x6) != 0x6)
+				return Level::SSE2;
+
+			__cpuidex(cpuInfo, 7, 0);
+			const bool hasAvx2{ (cpuInfo[1] & (1 << 5)) != 0 };
+
+			return hasAvx2 ? Level::AVX2 : Level::SSE2;
+		}
+
+		const char* GetLevelName(Level level)
+		{
+			switch (level)
+			{
+			case Level::Scalar:
+				return "Scalar";
+			case Level::SSE2:
+				return "SSE2 (4 wide)";
+			case Level::AVX2:
+				return "AVX2 (8 wide)";
+			}
+			return "Unknown";
+		}
+	}
+}
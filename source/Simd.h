@@ -0,0 +1,135 @@
+#pragma once
+#include <immintrin.h>
+
+namespace dae
+{
+	namespace Simd
+	{
+		enum class Level
+		{
+			Scalar,
+			SSE2,
+			AVX2
+		};
+
+		//Checks cpuid and whether the OS saves the AVX registers, so the AVX2 path is only picked when it can run
+		Level GetBestSupportedLevel();
+		const char* GetLevelName(Level level);
+
+		//1 lane, lets code that is written against Float4/Float8 run as plain scalar code too
+		struct Float1
+		{
+			using Float = float;
+			static constexpr int Width{ 1 };
+
+			static Float Set1(float v) { return v; }
+			static Float Load(const float* pData) { return *pData; }
+			static void Store(float* pData, Float v) { *pData = v; }
+
+			static Float Add(Float a, Float b) { return a + b; }
+			static Float Sub(Float a, Float b) { return a - b; }
+			static Float Mul(Float a, Float b) { return a * b; }
+			static Float Div(Float a, Float b) { return a / b; }
+		};
+
+		//4 lanes, SSE2 is part of x64 so this is always available
+		struct Float4
+		{
+			using Float = __m128;
+			using Int = __m128i;
+			static constexpr int Width{ 4 };
+
+			static Float Set1(float v) { return _mm_set1_ps(v); }
+			static Float Zero() { return _mm_setzero_ps(); }
+			static Float LaneOffsets() { return _mm_setr_ps(0.f, 1.f, 2.f, 3.f); }
+
+			static Float Load(const float* pData) { return _mm_loadu_ps(pData); }
+			//Only touches the first count floats, the other lanes get fill
+			static Float LoadPartial(const float* pData, int count, float fill)
+			{
+				alignas(16) float temp[Width];
+				for (int i{}; i < Width; ++i)
+					temp[i] = i < count ? pData[i] : fill;
+				return _mm_load_ps(temp);
+			}
+			static void Store(float* pData, Float v) { _mm_storeu_ps(pData, v); }
+
+			static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+			static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+			static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+			//Estimate plus one Newton-Raphson step, as accurate as FastMath::Rsqrt
+			static Float Rsqrt(Float v)
+			{
+				const Float estimate{ _mm_rsqrt_ps(v) };
+				return Mul(estimate, Sub(Set1(1.5f), Mul(Mul(Set1(0.5f), v), Mul(estimate, estimate))));
+			}
+
+			static Float CmpGt(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+			static Float CmpLt(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+			static Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+			//a where the mask lane is set, b elsewhere
+			static Float Select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+			static int MoveMask(Float v) { return _mm_movemask_ps(v); }
+
+			static Int Set1Int(int v) { return _mm_set1_epi32(v); }
+			//{ 0, step, 2 * step, 3 * step }, built from scalars since SSE2 has no 32 bit multiply
+			static Int LaneMultiples(int step) { return _mm_setr_epi32(0, step, 2 * step, 3 * step); }
+			static Int AddInt(Int a, Int b) { return _mm_add_epi32(a, b); }
+			static Int OrInt(Int a, Int b) { return _mm_or_si128(a, b); }
+			//All bits set in the lanes where v is negative, usable with Select
+			static Float NegativeMask(Int v) { return _mm_castsi128_ps(_mm_srai_epi32(v, 31)); }
+			static Float ToFloat(Int v) { return _mm_cvtepi32_ps(v); }
+		};
+
+		//8 lanes, only use after GetBestSupportedLevel() reported AVX2
+		struct Float8
+		{
+			using Float = __m256;
+			using Int = __m256i;
+			static constexpr int Width{ 8 };
+
+			static Float Set1(float v) { return _mm256_set1_ps(v); }
+			static Float Zero() { return _mm256_setzero_ps(); }
+			static Float LaneOffsets() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+
+			static Float Load(const float* pData) { return _mm256_loadu_ps(pData); }
+			//Only touches the first count floats, the other lanes get fill
+			static Float LoadPartial(const float* pData, int count, float fill)
+			{
+				alignas(32) float temp[Width];
+				for (int i{}; i < Width; ++i)
+					temp[i] = i < count ? pData[i] : fill;
+				return _mm256_load_ps(temp);
+			}
+			static void Store(float* pData, Float v) { _mm256_storeu_ps(pData, v); }
+
+			static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+			static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+			static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+			static Float Rsqrt(Float v)
+			{
+				const Float estimate{ _mm256_rsqrt_ps(v) };
+				return Mul(estimate, Sub(Set1(1.5f), Mul(Mul(Set1(0.5f), v), Mul(estimate, estimate))));
+			}
+
+			static Float CmpGt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+			static Float CmpLt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+			static Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+			static Float Select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+			static int MoveMask(Float v) { return _mm256_movemask_ps(v); }
+
+			static Int Set1Int(int v) { return _mm256_set1_epi32(v); }
+			static Int LaneMultiples(int step) { return _mm256_mullo_epi32(_mm256_set1_epi32(step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+			static Int AddInt(Int a, Int b) { return _mm256_add_epi32(a, b); }
+			static Int OrInt(Int a, Int b) { return _mm256_or_si256(a, b); }
+			static Float NegativeMask(Int v) { return _mm256_castsi256_ps(_mm256_srai_epi32(v, 31)); }
+			static Float ToFloat(Int v) { return _mm256_cvtepi32_ps(v); }
+		};
+	}
+}
@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "SplitSumLut.h"
+#include "FastMath.h"
+#include <cmath>
+
+namespace dae
+{
+	SplitSumLut::SplitSumLut(int size, int numSamples)
+		: m_Size{ size }
+	{
+		m_Entries.reserve(size_t(size) * size);
+		for (int roughnessIdx{}; roughnessIdx < size; ++roughnessIdx)
+		{
+			for (int nDotVIdx{}; nDotVIdx < size; ++nDotVIdx)
+			{
+				//Entries sit at cell centers, so the table never integrates the degenerate n.v = 0 or roughness = 0
+				m_Entries.emplace_back(Integrate((nDotVIdx + 0.5f) / size, (roughnessIdx + 0.5f) / size, numSamples));
+			}
+		}
+	}
+
+	Vector2 SplitSumLut::Sample(float nDotV, float roughness) const
+	{
+		const auto toCell = [this](float value, int& cell0, int& cell1)
+			{
+				//Argument order matters, this way NaN also ends up in the first cell instead of an index that doesn't exist
+				const float position{ std::max(std::min(float(m_Size - 1), value * m_Size - 0.5f), 0.f) };
+				cell0 = int(position);
+				cell1 = std::min(cell0 + 1, m_Size - 1);
+				return position - float(cell0);
+			};
+
+		int x0{}, x1{}, y0{}, y1{};
+		const float tx{ toCell(nDotV, x0, x1) };
+		const float ty{ toCell(roughness, y0, y1) };
+
+		const auto lerp = [](const Vector2& from, const Vector2& to, float t) { return from + (to - from) * t; };
+		const Vector2 top{ lerp(m_Entries[y0 * m_Size + x0], m_Entries[y0 * m_Size + x1], tx) };
+		const Vector2 bottom{ lerp(m_Entries[y1 * m_Size + x0], m_Entries[y1 * m_Size + x1], tx) };
+		return lerp(top, bottom, ty);
+	}
+
+	Vector2 SplitSumLut::Integrate(float nDotV, float roughness, int numSamples)
+	{
+		//In tangent space with n = +z, v in the xz plane
+		const Vector3 v{ std::sqrt(1.f - nDotV * nDotV), 0.f, nDotV };
+		//Same remapping as BRDF::NormalDistribution_GGX, and the image based lighting k of the Schlick-GGX geometry term
+		const float a{ Square(roughness) };
+		const float k{ a / 2.f };
+
+		float scale{};
+		float bias{};
+		for (int sampleIdx{}; sampleIdx < numSamples; ++sampleIdx)
+		{
+			//Hammersley point: i / N and the bit-reversed i
+			uint32_t bits{ uint32_t(sampleIdx) };
+			bits = (bits << 16u) | (bits >> 16u);
+			bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+			bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+			bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+			bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+			const float u{ float(sampleIdx) / numSamples };
+			const float w{ float(bits) * 2.3283064365386963e-10f };
+
+			//Half vector distributed like the GGX lobe, so the pdf cancels against D
+			const float phi{ 2.f * PI * u };
+			const float cosTheta{ std::sqrt((1.f - w) / (1.f + (Square(a) - 1.f) * w)) };
+			const float sinTheta{ std::sqrt(1.f - cosTheta * cosTheta) };
+			const Vector3 h{ sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta };
+			const float vDotH{ Vector3::Dot(v, h) };
+			const float nDotL{ 2.f * vDotH * h.z - v.z };
+			if (nDotL <= 0.f || vDotH <= 0.f)
+				continue;
+
+			const float geometry{ nDotL / (nDotL * (1.f - k) + k) * nDotV / (nDotV * (1.f - k) + k) };
+			const float visibility{ geometry * vDotH / (h.z * nDotV) };
+			const float fresnel{ FastMath::Schlick(vDotH) };
+			scale += (1.f - fresnel) * visibility;
+			bias += fresnel * visibility;
+		}
+		return { scale / numSamples, bias / numSamples };
+	}
+}
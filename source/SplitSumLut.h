@@ -0,0 +1,30 @@
+#pragma once
+#include "Math.h"
+#include <vector>
+
+namespace dae
+{
+	//The environment BRDF half of the split-sum approximation: how much of a uniform white environment the GGX lobe reflects, as f0 * scale + bias
+	//Tabulated over n.v and roughness once at startup, the other half is the environment light itself, which needs no prefiltering while it is uniform
+	class SplitSumLut final
+	{
+	public:
+		//Scale and bias are within 0.02 of a 4 times finer table above n.v = 1 / 32, they only ever multiply the ambient light
+		static constexpr int DefaultSize{ 32 };
+		static constexpr int DefaultNumSamples{ 256 };
+
+		//size x size entries, each one integrated with numSamples importance samples of the lobe
+		SplitSumLut(int size, int numSamples);
+
+		//Bilinear, both inputs are clamped to [0, 1] (NaN included); x is the scale of f0, y the bias
+		Vector2 Sample(float nDotV, float roughness) const;
+		int GetSize() const { return m_Size; }
+
+	private:
+		int m_Size{};
+		//Row per roughness, n.v along the row
+		std::vector<Vector2> m_Entries{};
+
+		static Vector2 Integrate(float nDotV, float roughness, int numSamples);
+	};
+}
@@ -1,13 +1,121 @@
 #include "pch.h"
 #include "Texture.h"
 #include "Vector2.h"
+#include "BlockCompression.h"
 #include <SDL_image.h>
+#include <array>
+#include <cstring>
+#include <cmath>
+#include <numeric>
+#include <execution>
+#include <emmintrin.h>
 
 
-Texture::Texture(ID3D11Device* pDevice, SDL_Surface* pSurface) :
-	m_pSurface{ pSurface },
-	m_pSurfacePixels{ (uint32_t*)pSurface->pixels }
+namespace
 {
+	//Moves the bits of v apart so a second value fits in between, interleaving two of them gives the Z-order (Morton) index
+	uint32_t SpreadBits(uint32_t v)
+	{
+		v &= 0x0000FFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	constexpr int SwizzleBlockShift{ 2 };
+	constexpr int SwizzleBlockSize{ 1 << SwizzleBlockShift };
+
+	using namespace dae::BlockCompression;
+
+	//BC3 puts the alpha block first, BC5 stores red then green
+	void EncodeBlock(Texture::Format format, const uint32_t* pTexels, uint64_t* pBlock)
+	{
+		uint8_t channels[2][NumBlockTexels]{};
+		switch (format)
+		{
+		case Texture::Format::BC1:
+			pBlock[0] = EncodeBC1(pTexels);
+			break;
+		case Texture::Format::BC3:
+			for (int i{}; i < NumBlockTexels; ++i)
+				channels[0][i] = uint8_t(pTexels[i] >> 24);
+			pBlock[0] = EncodeBC4(channels[0]);
+			pBlock[1] = EncodeBC1(pTexels);
+			break;
+		case Texture::Format::BC5:
+			for (int i{}; i < NumBlockTexels; ++i)
+			{
+				const uint32_t normal{ NormalizeNormal(pTexels[i]) };
+				channels[0][i] = uint8_t(normal);
+				channels[1][i] = uint8_t(normal >> 8);
+			}
+			pBlock[0] = EncodeBC4(channels[0]);
+			pBlock[1] = EncodeBC4(channels[1]);
+			break;
+		}
+	}
+
+	void DecodeBlock(Texture::Format format, const uint64_t* pBlock, uint32_t* pTexels)
+	{
+		uint8_t channels[2][NumBlockTexels]{};
+		switch (format)
+		{
+		case Texture::Format::BC1:
+			DecodeBC1(pBlock[0], pTexels);
+			break;
+		case Texture::Format::BC3:
+			DecodeBC1(pBlock[1], pTexels);
+			DecodeBC4(pBlock[0], channels[0]);
+			for (int i{}; i < NumBlockTexels; ++i)
+				pTexels[i] = (pTexels[i] & 0x00FFFFFF) | (uint32_t(channels[0][i]) << 24);
+			break;
+		case Texture::Format::BC5:
+			DecodeBC4(pBlock[0], channels[0]);
+			DecodeBC4(pBlock[1], channels[1]);
+			for (int i{}; i < NumBlockTexels; ++i)
+			{
+				const uint8_t red{ channels[0][i] };
+				const uint8_t green{ channels[1][i] };
+				pTexels[i] = red | (uint32_t(green) << 8) | (uint32_t(ReconstructNormalZ(red, green)) << 16) | 0xFF000000;
+			}
+			break;
+		}
+	}
+
+	constexpr std::array<float, 256> CreateUnormTable()
+	{
+		std::array<float, 256> table{};
+		for (int i{}; i < 256; ++i)
+			table[i] = i / 255.f;
+		return table;
+	}
+}
+
+const std::array<float, 256> Texture::s_UnormToFloat{ CreateUnormTable() };
+
+Texture::Texture(ID3D11Device* pDevice, SDL_Surface* pSurface)
+{
+	//Convert once at load, so sampling is a plain load instead of a SDL_GetRGB per texel
+	SDL_Surface* pConverted{ SDL_ConvertSurfaceFormat(pSurface, SDL_PIXELFORMAT_RGBA32, 0) };
+	MipLevel base{ CreateMipLevel(pConverted->w, pConverted->h) };
+	for (int y{}; y < base.height; ++y)
+	{
+		std::memcpy(base.pTexels + size_t(y) * base.width, static_cast<const uint8_t*>(pConverted->pixels) + size_t(y) * pConverted->pitch, base.width * sizeof(uint32_t));
+	}
+	SDL_FreeSurface(pConverted);
+
+	//Every level is a 2x2 box filter of the previous one
+	m_MipLevels.emplace_back(std::move(base));
+	while (m_MipLevels.back().width > 1 || m_MipLevels.back().height > 1)
+	{
+		const MipLevel& source{ m_MipLevels.back() };
+		MipLevel level{ CreateMipLevel(std::max(source.width / 2, 1), std::max(source.height / 2, 1)) };
+		DownsampleMipLevel(source, level);
+		m_MipLevels.emplace_back(std::move(level));
+	}
+
 	/*DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	D3D11_TEXTURE2D_DESC desc{};
 	desc.Width = pSurface->w;
@@ -42,7 +150,7 @@ Texture::Texture(ID3D11Device* pDevice, SDL_Surface* pSurface) :
 	if (FAILED(hr)) return;*/
 
 	// SDL_Surface is not needed anymore, so release it
-	//SDL_FreeSurface(pSurface);
+	SDL_FreeSurface(pSurface);
 }
 
 Texture::~Texture()
@@ -52,26 +160,107 @@ Texture::~Texture()
 		m_pSRV->Release();
 	if (m_pResource)
 		m_pResource->Release();
-	if (m_pSurface)
+	for (const MipLevel& level : m_MipLevels)
+	{
+		delete[] level.pTexels;
+		delete[] level.pBlocks;
+	}
+}
+
+Texture* Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path, Layout layout, Format format)
+{
+	Texture* texture{ Decode(path, format) };
+	if (texture && !texture->Finalize(pDevice, layout))
 	{
-		SDL_FreeSurface(m_pSurface);
-		m_pSurface = nullptr;
+		delete texture;
+		return nullptr;
 	}
+	return texture;
 }
 
-Texture* Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path)
+Texture* Texture::Decode(const std::string& path, Format format)
 {
 	//TODO
 	//Load SDL_Surface using IMG_LOAD
 	//Create & Return a new Texture Object (using SDL_Surface)
 
 	SDL_Surface* img = IMG_Load(path.c_str());
-	Texture* texture = new Texture{ pDevice,img };
+	if (!img)
+		return nullptr;
+
+	//The D3D copy is made in Finalize, on the thread that owns the device
+	Texture* texture = new Texture{ nullptr,img };
+	texture->Compress(format);
+
+	return texture;
+}
+
+void Texture::Compress(Format format)
+{
+	if (m_Format != Format::RGBA8 || m_Layout != Layout::Linear)
+		return;
+
+	const MipLevel& base{ m_MipLevels[0] };
+	if (base.width % BlockSize != 0 || base.height % BlockSize != 0)
+		format = Format::RGBA8;
+	//Every level is encoded from the full quality level above it, not from an already compressed one
+	if (format != Format::RGBA8)
+	{
+		for (MipLevel& level : m_MipLevels)
+		{
+			CompressMipLevel(level, format);
+		}
+	}
+	m_Format = format;
+}
+
+bool Texture::Finalize(ID3D11Device* pDevice, Layout layout)
+{
+	if (pDevice && !CreateResource(pDevice))
+		return false;
+
+	//D3D got its linear copy, so the CPU side is free to reorder the texels (or blocks) now
+	if (layout == Layout::Swizzled && m_Layout == Layout::Linear)
+	{
+		for (MipLevel& level : m_MipLevels)
+		{
+			SwizzleMipLevel(level);
+		}
+	}
+	m_Layout = layout;
+
+	return true;
+}
+
+void Texture::ReleaseCpuCopy()
+{
+	for (int levelIdx{}; levelIdx < int(m_MipLevels.size()); ++levelIdx)
+	{
+		ReleaseLevel(levelIdx);
+	}
+}
+
+bool Texture::CreateResource(ID3D11Device* pDevice)
+{
+	//The texels are already RGBA8 or in the BC layout D3D expects, so they can be uploaded as they are
 	DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	switch (m_Format)
+	{
+	case Format::BC1:
+		format = DXGI_FORMAT_BC1_UNORM;
+		break;
+	case Format::BC3:
+		format = DXGI_FORMAT_BC3_UNORM;
+		break;
+	case Format::BC5:
+		format = DXGI_FORMAT_BC5_UNORM;
+		break;
+	}
+
 	D3D11_TEXTURE2D_DESC desc{};
-	desc.Width = img->w;
-	desc.Height = img->h;
-	desc.MipLevels = 1;
+	desc.Width = m_MipLevels[0].width;
+	desc.Height = m_MipLevels[0].height;
+	desc.MipLevels = static_cast<UINT>(m_MipLevels.size());
 	desc.ArraySize = 1;
 	desc.Format = format;
 	desc.SampleDesc.Count = 1;
@@ -81,91 +270,289 @@ Texture* Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path)
 	desc.CPUAccessFlags = 0;
 	desc.MiscFlags = 0;
 
-	D3D11_SUBRESOURCE_DATA initData{};
-	initData.pSysMem = img->pixels;
-	initData.SysMemPitch = static_cast<UINT>(img->pitch);
-	initData.SysMemSlicePitch = static_cast<UINT>(img->h * img->pitch);
+	//One subresource per mip level, so the shader's MIN_MAG_MIP_LINEAR sampler has levels to blend
+	std::vector<D3D11_SUBRESOURCE_DATA> initData(m_MipLevels.size());
+	for (size_t i{}; i < initData.size(); ++i)
+	{
+		const MipLevel& level{ m_MipLevels[i] };
+		if (level.pBlocks)
+		{
+			//A row of blocks covers 4 rows of texels
+			initData[i].pSysMem = level.pBlocks;
+			initData[i].SysMemPitch = static_cast<UINT>(level.xOffsets.size() * GetBlockWords(level.format) * sizeof(uint64_t));
+			initData[i].SysMemSlicePitch = static_cast<UINT>(level.yOffsets.size() * initData[i].SysMemPitch);
+			continue;
+		}
+		initData[i].pSysMem = level.pTexels;
+		initData[i].SysMemPitch = static_cast<UINT>(level.width * sizeof(uint32_t));
+		initData[i].SysMemSlicePitch = static_cast<UINT>(level.height * initData[i].SysMemPitch);
+	}
 
-	HRESULT hr = pDevice->CreateTexture2D(&desc, &initData, &texture->m_pResource);
+	HRESULT hr = pDevice->CreateTexture2D(&desc, initData.data(), &m_pResource);
 	if (FAILED(hr))
 	{
-		delete texture;
-		return nullptr;
-
+		return false;
 	}
 
 	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc{};
 	SRVDesc.Format = format;
 	SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	SRVDesc.Texture2D.MipLevels = 1;
+	SRVDesc.Texture2D.MipLevels = desc.MipLevels;
 
 
-	hr = pDevice->CreateShaderResourceView(texture->m_pResource, &SRVDesc, &texture->m_pSRV);
+	hr = pDevice->CreateShaderResourceView(m_pResource, &SRVDesc, &m_pSRV);
 	if (FAILED(hr))
 	{
-		delete texture;
-		return nullptr;
-
+		return false;
 	}
 
+	return true;
+}
 
-	return texture;
+Texture::MipLevel Texture::CreateMipLevel(int width, int height)
+{
+	MipLevel level{ nullptr, width, height };
+	const size_t numTexels{ CreateTexelOffsets(Layout::Linear, width, height, level.xOffsets, level.yOffsets) };
+	level.pTexels = new uint32_t[numTexels];
+	level.sizeInBytes = numTexels * sizeof(uint32_t);
+	return level;
 }
 
-dae::ColorRGB Texture::Sample(const dae::Vector2& uv, bool useLinearFiltering) const
+size_t Texture::CreateTexelOffsets(Layout layout, int width, int height, std::vector<uint32_t>& xOffsets, std::vector<uint32_t>& yOffsets)
 {
-	if (useLinearFiltering)
+	xOffsets.resize(width);
+	yOffsets.resize(height);
+
+	if (layout == Layout::Linear)
 	{
-		// Calculate the floating-point pixel coordinates within the texture
-		const float x = uv.x * m_pSurface->w;
-		const float y = uv.y * m_pSurface->h;
+		for (int x{}; x < width; ++x)
+			xOffsets[x] = uint32_t(x);
+		for (int y{}; y < height; ++y)
+			yOffsets[y] = uint32_t(y * width);
+		return size_t(width) * height;
+	}
+
+	//Inside a block the texels stay row-major, the blocks themselves follow the Z-order curve
+	for (int x{}; x < width; ++x)
+		xOffsets[x] = (SpreadBits(uint32_t(x) >> SwizzleBlockShift) << (2 * SwizzleBlockShift)) | (uint32_t(x) & (SwizzleBlockSize - 1));
+	for (int y{}; y < height; ++y)
+		yOffsets[y] = (SpreadBits(uint32_t(y) >> SwizzleBlockShift) << (2 * SwizzleBlockShift + 1)) | ((uint32_t(y) & (SwizzleBlockSize - 1)) << SwizzleBlockShift);
+
+	const uint32_t lastBlock{ (xOffsets.back() | yOffsets.back()) >> (2 * SwizzleBlockShift) };
+	return size_t(lastBlock + 1) * SwizzleBlockSize * SwizzleBlockSize;
+}
+
+float Texture::CalculateLod(const dae::Vector2& uvDx, const dae::Vector2& uvDy, int width, int height, int numLevels)
+{
+	const dae::Vector2 texelDx{ uvDx.x * width, uvDx.y * height };
+	const dae::Vector2 texelDy{ uvDy.x * width, uvDy.y * height };
+	const float maxLengthSquared{ std::max(texelDx.SqrMagnitude(), texelDy.SqrMagnitude()) };
+	return std::clamp(0.5f * std::log2(maxLengthSquared), 0.f, float(numLevels - 1));
+}
 
-		// Get the integer coordinates of the four texels surrounding the UV coordinates
-		const int x0 = static_cast<int>(x);
-		const int x1 = x0 + 1;
-		const int y0 = static_cast<int>(y);
-		const int y1 = y0 + 1;
+int Texture::CalculateAnisotropy(const dae::Vector2& uvDx, const dae::Vector2& uvDy, int width, int height, int numLevels, int maxAnisotropy,
+	float& lod, dae::Vector2& probeStep)
+{
+	const dae::Vector2 texelDx{ uvDx.x * width, uvDx.y * height };
+	const dae::Vector2 texelDy{ uvDy.x * width, uvDy.y * height };
+	const float lengthX{ texelDx.Magnitude() };
+	const float lengthY{ texelDy.Magnitude() };
+	const bool isMajorX{ lengthX >= lengthY };
+	const float majorLength{ isMajorX ? lengthX : lengthY };
+	const float minorLength{ isMajorX ? lengthY : lengthX };
+
+	//One probe per minor-axis-sized piece of the major axis, the level then only has to cover one piece
+	const float ratio{ majorLength / std::max(minorLength, 1e-6f) };
+	const int numProbes{ std::max(int(std::ceil(std::min(ratio, float(maxAnisotropy)))), 1) };
+
+	lod = std::clamp(std::log2(std::max(majorLength / float(numProbes), 1e-6f)), 0.f, float(numLevels - 1));
+	probeStep = (isMajorX ? uvDx : uvDy) / float(numProbes);
+	return numProbes;
+}
 
-		// Calculate the fractional parts of the coordinates
-		const float dx = x - static_cast<float>(x0);
-		const float dy = y - static_cast<float>(y0);
+void Texture::DownsampleMipLevel(const MipLevel& source, const MipLevel& destination)
+{
+	//Rows are independent, so they are spread over all cores; odd sizes drop the last row/column like D3D's level sizes do
+	std::vector<int> rows(destination.height);
+	std::iota(rows.begin(), rows.end(), 0);
+	std::for_each(std::execution::par, rows.begin(), rows.end(), [&source, &destination](int y)
+		{
+			const uint32_t* pRow0{ source.pTexels + size_t(std::min(2 * y, source.height - 1)) * source.width };
+			const uint32_t* pRow1{ source.pTexels + size_t(std::min(2 * y + 1, source.height - 1)) * source.width };
+			uint32_t* pDestination{ destination.pTexels + size_t(y) * destination.width };
+
+			int x{};
+			//SSE2: 4 destination texels from 8 texels of both source rows, every channel summed in 16 bit
+			const __m128i zero{ _mm_setzero_si128() };
+			const __m128i rounding{ _mm_set1_epi16(2) };
+			const auto averageQuads = [&zero, &rounding](__m128i row0, __m128i row1)
+				{
+					const __m128i low{ _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero)) };
+					const __m128i high{ _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero)) };
+					//Add the neighbouring texel, which sits in the upper 64 bits
+					const __m128i sums{ _mm_unpacklo_epi64(_mm_add_epi16(low, _mm_srli_si128(low, 8)), _mm_add_epi16(high, _mm_srli_si128(high, 8))) };
+					return _mm_srli_epi16(_mm_add_epi16(sums, rounding), 2);
+				};
+
+			for (; x + 4 <= destination.width; x += 4)
+			{
+				const __m128i* pSource0{ reinterpret_cast<const __m128i*>(pRow0 + 2 * x) };
+				const __m128i* pSource1{ reinterpret_cast<const __m128i*>(pRow1 + 2 * x) };
+				const __m128i first{ averageQuads(_mm_loadu_si128(pSource0), _mm_loadu_si128(pSource1)) };
+				const __m128i second{ averageQuads(_mm_loadu_si128(pSource0 + 1), _mm_loadu_si128(pSource1 + 1)) };
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + x), _mm_packus_epi16(first, second));
+			}
+
+			for (; x < destination.width; ++x)
+			{
+				const int x0{ std::min(2 * x, source.width - 1) };
+				const int x1{ std::min(2 * x + 1, source.width - 1) };
+				uint32_t texel{};
+				for (int channel{}; channel < 4; ++channel)
+				{
+					const int shift{ channel * 8 };
+					const uint32_t sum
+					{
+						((pRow0[x0] >> shift) & 0xFF) + ((pRow0[x1] >> shift) & 0xFF) +
+						((pRow1[x0] >> shift) & 0xFF) + ((pRow1[x1] >> shift) & 0xFF)
+					};
+					texel |= ((sum + 2) / 4) << shift;
+				}
+				pDestination[x] = texel;
+			}
+		});
+}
 
-		// Sample the colors of the four surrounding texels
-		const SDL_PixelFormat* format = m_pSurface->format;
-		Uint8 red[4];
-		Uint8 green[4];
-		Uint8 blue[4];
+void Texture::SwizzleMipLevel(MipLevel& level)
+{
+	std::vector<uint32_t> xOffsets{};
+	std::vector<uint32_t> yOffsets{};
 
-		SDL_GetRGB(m_pSurfacePixels[x0 + y0 * m_pSurface->w], format, &red[0], &green[0], &blue[0]);
-		SDL_GetRGB(m_pSurfacePixels[x1 + y0 * m_pSurface->w], format, &red[1], &green[1], &blue[1]);
-		SDL_GetRGB(m_pSurfacePixels[x0 + y1 * m_pSurface->w], format, &red[2], &green[2], &blue[2]);
-		SDL_GetRGB(m_pSurfacePixels[x1 + y1 * m_pSurface->w], format, &red[3], &green[3], &blue[3]);
+	//Blocks are moved as a whole, the Z-order then runs over groups of blocks
+	if (level.pBlocks)
+	{
+		const int numBlocksX{ int(level.xOffsets.size()) };
+		const int numBlocksY{ int(level.yOffsets.size()) };
+		const int blockWords{ GetBlockWords(level.format) };
+		const size_t numBlocks{ CreateTexelOffsets(Layout::Swizzled, numBlocksX, numBlocksY, xOffsets, yOffsets) };
+		uint64_t* pSwizzled{ new uint64_t[numBlocks * blockWords]{} };
+		for (int by{}; by < numBlocksY; ++by)
+		{
+			for (int bx{}; bx < numBlocksX; ++bx)
+			{
+				std::copy_n(level.pBlocks + size_t(level.xOffsets[bx] + level.yOffsets[by]) * blockWords, blockWords,
+					pSwizzled + size_t(xOffsets[bx] + yOffsets[by]) * blockWords);
+			}
+		}
+
+		delete[] level.pBlocks;
+		level.pBlocks = pSwizzled;
+		level.sizeInBytes = numBlocks * blockWords * sizeof(uint64_t);
+		level.xOffsets = std::move(xOffsets);
+		level.yOffsets = std::move(yOffsets);
+		return;
+	}
 
-		// Perform bilinear interpolation to get the final color
-		const float invDx = 1.0f - dx;
-		const float invDy = 1.0f - dy;
+	const size_t numTexels{ CreateTexelOffsets(Layout::Swizzled, level.width, level.height, xOffsets, yOffsets) };
+	uint32_t* pSwizzled{ new uint32_t[numTexels]{} };
+	for (int y{}; y < level.height; ++y)
+	{
+		for (int x{}; x < level.width; ++x)
+		{
+			pSwizzled[xOffsets[x] + yOffsets[y]] = GetTexel(level, x, y);
+		}
+	}
 
-		const float redF = invDx * invDy * red[0] + dx * invDy * red[1] + invDx * dy * red[2] + dx * dy * red[3];
-		const float greenF = invDx * invDy * green[0] + dx * invDy * green[1] + invDx * dy * green[2] + dx * dy * green[3];
-		const float blueF = invDx * invDy * blue[0] + dx * invDy * blue[1] + invDx * dy * blue[2] + dx * dy * blue[3];
+	delete[] level.pTexels;
+	level.pTexels = pSwizzled;
+	level.sizeInBytes = numTexels * sizeof(uint32_t);
+	level.xOffsets = std::move(xOffsets);
+	level.yOffsets = std::move(yOffsets);
+}
 
-		// Convert the RGB values to the range [0, 1] and create the final ColorRGB structure
-		dae::ColorRGB color;
-		color.r = redF / 255.0f;
-		color.g = greenF / 255.0f;
-		color.b = blueF / 255.0f;
+void Texture::CompressMipLevel(MipLevel& level, Format format)
+{
+	const int numBlocksX{ (level.width + BlockSize - 1) / BlockSize };
+	const int numBlocksY{ (level.height + BlockSize - 1) / BlockSize };
+	const int blockWords{ GetBlockWords(format) };
+	uint64_t* pBlocks{ new uint64_t[size_t(numBlocksX) * numBlocksY * blockWords] };
+
+	//Block rows are independent, so they are spread over all cores
+	std::vector<int> blockRows(numBlocksY);
+	std::iota(blockRows.begin(), blockRows.end(), 0);
+	std::for_each(std::execution::par, blockRows.begin(), blockRows.end(), [&level, format, numBlocksX, blockWords, pBlocks](int by)
+		{
+			for (int bx{}; bx < numBlocksX; ++bx)
+			{
+				//Levels smaller than a block repeat their last row and column
+				uint32_t texels[NumBlockTexels]{};
+				for (int i{}; i < NumBlockTexels; ++i)
+				{
+					const int x{ std::min(bx * BlockSize + i % BlockSize, level.width - 1) };
+					const int y{ std::min(by * BlockSize + i / BlockSize, level.height - 1) };
+					texels[i] = GetTexel(level, x, y);
+				}
+				EncodeBlock(format, texels, pBlocks + (size_t(by) * numBlocksX + bx) * blockWords);
+			}
+		});
+
+	delete[] level.pTexels;
+	level.pTexels = nullptr;
+	level.pBlocks = pBlocks;
+	level.format = format;
+	level.cacheId = CreateCacheId();
+	level.sizeInBytes = CreateTexelOffsets(Layout::Linear, numBlocksX, numBlocksY, level.xOffsets, level.yOffsets) * blockWords * sizeof(uint64_t);
+}
 
-		return color;
+uint32_t Texture::GetCompressedTexel(const MipLevel& level, int x, int y)
+{
+	thread_local BlockCache<uint32_t, 6> blockCache{};
+
+	const uint32_t blockIdx{ level.xOffsets[uint32_t(x) / BlockSize] + level.yOffsets[uint32_t(y) / BlockSize] };
+	const uint32_t* pTexels{ blockCache.Find((uint64_t(level.cacheId) << 32) | blockIdx, [&level, blockIdx](uint32_t* pDecoded)
+		{
+			DecodeBlock(level.format, level.pBlocks + size_t(blockIdx) * GetBlockWords(level.format), pDecoded);
+		}) };
+	return pTexels[(y % BlockSize) * BlockSize + x % BlockSize];
+}
+
+size_t Texture::GetMemorySize() const
+{
+	size_t size{};
+	for (int levelIdx{ GetFirstResidentLevel() }; levelIdx < int(m_MipLevels.size()); ++levelIdx)
+	{
+		if (GetLevelData(levelIdx))
+			size += m_MipLevels[levelIdx].sizeInBytes;
 	}
+	return size;
+}
 
-	//Sample the correct texel for the given uv
-	SDL_PixelFormat* frmt = m_pSurface->format;
-	Uint8 red{};
-	Uint8 green{};
-	Uint8 blue{};
-	dae::Vector2 convertedUVRange{ uv.x* m_pSurface->w, uv.y* m_pSurface->h };
+const void* Texture::GetLevelData(int levelIdx) const
+{
+	const MipLevel& level{ m_MipLevels[levelIdx] };
+	if (level.pBlocks)
+		return level.pBlocks;
+	return level.pTexels;
+}
 
-	SDL_GetRGB(m_pSurfacePixels[int(convertedUVRange.x) + int(convertedUVRange.y) * m_pSurface->w], frmt, &red, &green, &blue);
-	dae::ColorRGB color = { red / 255.f, green / 255.f, blue / 255.f };
-	return color;
-}
\ No newline at end of file
+void Texture::ReleaseLevel(int levelIdx)
+{
+	MipLevel& level{ m_MipLevels[levelIdx] };
+	delete[] level.pTexels;
+	delete[] level.pBlocks;
+	level.pTexels = nullptr;
+	level.pBlocks = nullptr;
+}
+
+void* Texture::AllocateLevel(int levelIdx)
+{
+	//The offsets and sizes stay while a level is paged out, only the texels go
+	MipLevel& level{ m_MipLevels[levelIdx] };
+	if (level.format != Format::RGBA8)
+	{
+		level.pBlocks = new uint64_t[level.sizeInBytes / sizeof(uint64_t)];
+		return level.pBlocks;
+	}
+	level.pTexels = new uint32_t[level.sizeInBytes / sizeof(uint32_t)];
+	return level.pTexels;
+}
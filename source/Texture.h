@@ -1,25 +1,258 @@
 #pragma once
 #include "Math.h"
+#include "SamplerState.h"
+#include "TextureResidency.h"
+#include <array>
 #include <string>
+#include <vector>
 #include <SDL_surface.h>
 
-class Texture
+class Texture : public StreamedMipChain
 {
 public:
-	~Texture();
+	//How the texels of every level are ordered in memory, the D3D copy is always linear
+	enum class Layout
+	{
+		//Row-major
+		Linear,
+		//4x4 texel blocks in Z-order, so a bilinear footprint or a rotated walk mostly stays within a few cache lines
+		Swizzled
+	};
 
-	static Texture* LoadFromFile(ID3D11Device* pDevice,const std::string& path);
-	dae::ColorRGB Sample(const dae::Vector2& uv, bool useLinearFiltering = false) const;
+	//How the CPU copy and the D3D resource store the texels
+	enum class Format
+	{
+		//32 bits per texel
+		RGBA8,
+		//4 bits per texel, rgb only
+		BC1,
+		//8 bits per texel, BC1 rgb plus a separately interpolated alpha
+		BC3,
+		//8 bits per texel, only red and green are stored; blue is rebuilt as the z of a unit normal, so this is for normal maps
+		//The normals are rescaled to unit length before encoding, every mip level included
+		BC5
+	};
+
+	~Texture() override;
+
+	//Without a device only the CPU copy is created, which is enough for the software rasterizer and the benchmarks
+	//Block-compressed formats are encoded at load and fall back to RGBA8 when the size isn't a multiple of 4, which D3D requires
+	static Texture* LoadFromFile(ID3D11Device* pDevice,const std::string& path, Layout layout = Layout::Swizzled, Format format = Format::RGBA8);
+	//First half of LoadFromFile: decode, mip chain and block compression, doesn't touch D3D so it can run on any thread
+	//The texels stay linear, which is the order D3D uploads, until Finalize
+	static Texture* Decode(const std::string& path, Format format = Format::RGBA8);
+	//Block-compresses a texture decoded as RGBA8, before Finalize; for callers that read the full quality texels first
+	void Compress(Format format);
+	//Second half: creates the D3D copy when there is a device, then puts the CPU copy in its final layout
+	bool Finalize(ID3D11Device* pDevice, Layout layout = Layout::Swizzled);
+	//Frees the texels of every level for a texture only D3D samples, after Finalize; it can't be sampled on the CPU anymore
+	void ReleaseCpuCopy();
+	//Samples the full resolution level, or the finest one in memory
+	template<typename Sampler>
+	dae::ColorRGB Sample(const Sampler& sampler, const dae::Vector2& uv) const { return SampleLevel(sampler, uv, int(RequestLod(0.f))); }
+	//Picks the mip level from the screen-space uv derivatives like HLSL SampleGrad, linear filtering also blends between levels
+	//Anisotropic filtering averages trilinear probes along the longer footprint axis, on a level picked from the shorter one
+	template<typename Sampler>
+	dae::ColorRGB SampleGrad(const Sampler& sampler, const dae::Vector2& uv, const dae::Vector2& uvDx, const dae::Vector2& uvDy) const;
 	ID3D11ShaderResourceView* GetSRV() const {return m_pSRV;}
 
+	Layout GetLayout() const { return m_Layout; }
+	Format GetFormat() const { return m_Format; }
+	//Bytes of texel data the CPU copy keeps in memory, all resident levels together
+	size_t GetMemorySize() const;
+	int GetNumMipLevels() const override { return int(m_MipLevels.size()); }
+	int GetWidth(int levelIdx = 0) const { return m_MipLevels[levelIdx].width; }
+	int GetHeight(int levelIdx = 0) const { return m_MipLevels[levelIdx].height; }
+	//Position of texel (x, y) in the texel buffer of an RGBA8 level, works for either layout
+	size_t GetTexelIndex(int levelIdx, int x, int y) const { return m_MipLevels[levelIdx].xOffsets[x] + m_MipLevels[levelIdx].yOffsets[y]; }
+	//Raw RGBA8 texel, red in the lowest byte; block-compressed levels decode the block it's in. The level has to be resident
+	uint32_t GetTexel(int levelIdx, int x, int y) const { return GetTexel(m_MipLevels[levelIdx], x, y); }
+
+	//Addressing of a width x height level in the given layout: texel (x, y) lives at xOffsets[x] + yOffsets[y]
+	//Returns how many texels the buffer needs, the Z-order curve leaves gaps when a side isn't a power of two
+	static size_t CreateTexelOffsets(Layout layout, int width, int height, std::vector<uint32_t>& xOffsets, std::vector<uint32_t>& yOffsets);
+	//Mip level where one pixel step covers about one texel, clamped to the levels that exist
+	static float CalculateLod(const dae::Vector2& uvDx, const dae::Vector2& uvDy, int width, int height, int numLevels);
+	//Splits a stretched footprint into up to maxAnisotropy square pieces, returns how many probes to take
+	//lod is the level for one piece, probeStep the uv distance between two neighbouring probes
+	static int CalculateAnisotropy(const dae::Vector2& uvDx, const dae::Vector2& uvDy, int width, int height, int numLevels, int maxAnisotropy,
+		float& lod, dae::Vector2& probeStep);
+
 private:
 	Texture(ID3D11Device* pDevice,SDL_Surface* pSurface);
 
-	SDL_Surface* m_pSurface{ nullptr };
-	uint32_t* m_pSurfacePixels{ nullptr };
-	SDL_PixelFormat* m_pFormat{};
+	struct MipLevel
+	{
+		//RGBA8 with red in the lowest byte, whatever format the file had; nullptr once the level is block-compressed or paged out
+		uint32_t* pTexels{ nullptr };
+		int width{};
+		int height{};
+		//Texel (x, y) is at xOffsets[x] + yOffsets[y], both layouts split into an x and a y part so sampling doesn't care which one it is
+		//Compressed levels address blocks instead, block (x / 4, y / 4) starts at word (xOffsets[x / 4] + yOffsets[y / 4]) * GetBlockWords(format)
+		std::vector<uint32_t> xOffsets{};
+		std::vector<uint32_t> yOffsets{};
+		size_t sizeInBytes{};
+
+		uint64_t* pBlocks{ nullptr };
+		Format format{ Format::RGBA8 };
+		//Keys the decoded blocks of this level in the per-thread block cache
+		uint32_t cacheId{};
+	};
+	//Level 0 is the full resolution, every next level halves both sides down to 1x1
+	std::vector<MipLevel> m_MipLevels{};
+	Layout m_Layout{ Layout::Linear };
+	Format m_Format{ Format::RGBA8 };
+
+	size_t GetLevelSize(int levelIdx) const override { return m_MipLevels[levelIdx].sizeInBytes; }
+	const void* GetLevelData(int levelIdx) const override;
+	void ReleaseLevel(int levelIdx) override;
+	void* AllocateLevel(int levelIdx) override;
+
+	bool CreateResource(ID3D11Device* pDevice);
+	static MipLevel CreateMipLevel(int width, int height);
+	static void DownsampleMipLevel(const MipLevel& source, const MipLevel& destination);
+	static void SwizzleMipLevel(MipLevel& level);
+	static void CompressMipLevel(MipLevel& level, Format format);
+	//64 bit words per 4x4 block
+	static int GetBlockWords(Format format) { return format == Format::BC1 ? 1 : 2; }
+	static uint32_t GetTexel(const MipLevel& level, int x, int y)
+	{
+		if (level.pBlocks)
+			return GetCompressedTexel(level, x, y);
+		return level.pTexels[level.xOffsets[x] + level.yOffsets[y]];
+	}
+	//Decodes through a small per-thread cache, so the 4 texels of a bilinear footprint mostly cost one decode
+	static uint32_t GetCompressedTexel(const MipLevel& level, int x, int y);
+	//Coordinates have gone through AddressTexel already, -1 stands for the border
+	template<typename Sampler>
+	static uint32_t FetchTexel(const MipLevel& level, int x, int y, uint32_t borderTexel);
+	template<typename Sampler>
+	dae::ColorRGB SampleLevel(const Sampler& sampler, const dae::Vector2& uv, int levelIdx) const;
+	//Bilinear on the two levels around lod and blend
+	template<typename Sampler>
+	dae::ColorRGB SampleTrilinear(const Sampler& sampler, const dae::Vector2& uv, float lod) const;
+
+	//unorm8 to [0, 1], a table load instead of a conversion and a divide per channel
+	static const std::array<float, 256> s_UnormToFloat;
+	static float GetChannel(uint32_t texel, int channel) { return s_UnormToFloat[(texel >> (channel * 8)) & 0xFF]; }
 
 	ID3D11Texture2D* m_pResource{nullptr};
 	ID3D11ShaderResourceView* m_pSRV{nullptr};
 };
 
+
+template<typename Sampler>
+dae::ColorRGB Texture::SampleGrad(const Sampler& sampler, const dae::Vector2& uv, const dae::Vector2& uvDx, const dae::Vector2& uvDy) const
+{
+	const MipLevel& base{ m_MipLevels[0] };
+
+	if constexpr (Sampler::filter == TextureFilter::Anisotropic)
+	{
+		float lod{};
+		dae::Vector2 probeStep{};
+		const int numProbes{ CalculateAnisotropy(uvDx, uvDy, base.width, base.height, int(m_MipLevels.size()), sampler.maxAnisotropy, lod, probeStep) };
+		if (numProbes == 1)
+			return SampleTrilinear(sampler, uv, RequestLod(lod));
+
+		//The probes are spread evenly over the footprint, centered on uv
+		dae::Vector2 probeUV{ uv - probeStep * (0.5f * float(numProbes - 1)) };
+		const float residentLod{ RequestLod(lod) };
+		dae::ColorRGB color{};
+		for (int i{}; i < numProbes; ++i)
+		{
+			color += SampleTrilinear(sampler, probeUV, residentLod);
+			probeUV += probeStep;
+		}
+		return color / float(numProbes);
+	}
+	else
+	{
+		const float lod{ CalculateLod(uvDx, uvDy, base.width, base.height, int(m_MipLevels.size())) };
+		if constexpr (Sampler::filter == TextureFilter::Point)
+			return SampleLevel(sampler, uv, int(RequestLod(lod + 0.5f)));
+		else
+			return SampleTrilinear(sampler, uv, RequestLod(lod));
+	}
+}
+
+template<typename Sampler>
+dae::ColorRGB Texture::SampleTrilinear(const Sampler& sampler, const dae::Vector2& uv, float lod) const
+{
+	const int levelIdx{ int(lod) };
+	const dae::ColorRGB color{ SampleLevel(sampler, uv, levelIdx) };
+	const float blend{ lod - float(levelIdx) };
+	if (blend == 0.f)
+		return color;
+
+	return dae::ColorRGB::Lerp(color, SampleLevel(sampler, uv, levelIdx + 1), blend);
+}
+
+template<typename Sampler>
+uint32_t Texture::FetchTexel(const MipLevel& level, int x, int y, uint32_t borderTexel)
+{
+	if constexpr (Sampler::hasBorder)
+	{
+		if (x < 0 || y < 0)
+			return borderTexel;
+	}
+	return GetTexel(level, x, y);
+}
+
+template<typename Sampler>
+dae::ColorRGB Texture::SampleLevel(const Sampler& sampler, const dae::Vector2& uv, int levelIdx) const
+{
+	const MipLevel& level{ m_MipLevels[levelIdx] };
+	uint32_t borderTexel{};
+	if constexpr (Sampler::hasBorder)
+		borderTexel = sampler.GetBorderTexel();
+
+	if constexpr (Sampler::filter != TextureFilter::Point)
+	{
+		// Calculate the floating-point pixel coordinates within the texture, relative to the texel centers like D3D does
+		const float x = uv.x * level.width - 0.5f;
+		const float y = uv.y * level.height - 0.5f;
+
+		// Get the integer coordinates of the four texels surrounding the UV coordinates, the address modes take care of the edges
+		const int x0 = FloorToTexel(x);
+		const int y0 = FloorToTexel(y);
+		const int addressedX0 = AddressTexel<Sampler::addressU>(x0, level.width);
+		const int addressedX1 = AddressTexel<Sampler::addressU>(x0 + 1, level.width);
+		const int addressedY0 = AddressTexel<Sampler::addressV>(y0, level.height);
+		const int addressedY1 = AddressTexel<Sampler::addressV>(y0 + 1, level.height);
+
+		// Calculate the fractional parts of the coordinates
+		const float dx = x - static_cast<float>(x0);
+		const float dy = y - static_cast<float>(y0);
+
+		// Sample the colors of the four surrounding texels
+		const uint32_t texels[4]
+		{
+			FetchTexel<Sampler>(level, addressedX0, addressedY0, borderTexel),
+			FetchTexel<Sampler>(level, addressedX1, addressedY0, borderTexel),
+			FetchTexel<Sampler>(level, addressedX0, addressedY1, borderTexel),
+			FetchTexel<Sampler>(level, addressedX1, addressedY1, borderTexel)
+		};
+
+		// Perform bilinear interpolation to get the final color
+		const float invDx = 1.0f - dx;
+		const float invDy = 1.0f - dy;
+		const float weights[4]{ invDx * invDy, dx * invDy, invDx * dy, dx * dy };
+
+		dae::ColorRGB color{};
+		for (int i{}; i < 4; ++i)
+		{
+			color.r += weights[i] * GetChannel(texels[i], 0);
+			color.g += weights[i] * GetChannel(texels[i], 1);
+			color.b += weights[i] * GetChannel(texels[i], 2);
+		}
+		return color;
+	}
+	else
+	{
+		//Sample the correct texel for the given uv
+		const int x{ AddressTexel<Sampler::addressU>(FloorToTexel(uv.x * level.width), level.width) };
+		const int y{ AddressTexel<Sampler::addressV>(FloorToTexel(uv.y * level.height), level.height) };
+		const uint32_t texel{ FetchTexel<Sampler>(level, x, y, borderTexel) };
+		return { GetChannel(texel, 0), GetChannel(texel, 1), GetChannel(texel, 2) };
+	}
+}
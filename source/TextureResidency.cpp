@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "TextureResidency.h"
+#include <filesystem>
+
+TextureResidency::TextureResidency(size_t budgetInBytes, const std::string& pageFilePath)
+	: m_PageFile{ pageFilePath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc }
+	, m_PageFilePath{ pageFilePath }
+	, m_Budget{ budgetInBytes }
+{
+	if (!m_PageFile)
+		std::cout << "Couldn't create texture page file " << pageFilePath << ", textures stay resident\n";
+}
+
+TextureResidency::~TextureResidency()
+{
+	m_PageFile.close();
+	std::error_code error{};
+	std::filesystem::remove(m_PageFilePath, error);
+}
+
+void TextureResidency::Register(StreamedMipChain* pChain)
+{
+	Entry entry{ pChain };
+	const int numLevels{ pChain->GetNumMipLevels() };
+	entry.lastUsedFrames.resize(numLevels, m_Frame);
+
+	//Levels never change after loading, so one copy in the page file is enough for every eviction
+	if (m_PageFile)
+	{
+		m_PageFile.seekp(0, std::ios::end);
+		for (int levelIdx{}; levelIdx < numLevels; ++levelIdx)
+		{
+			entry.pageOffsets.emplace_back(m_PageFile.tellp());
+			m_PageFile.write(static_cast<const char*>(pChain->GetLevelData(levelIdx)), std::streamsize(pChain->GetLevelSize(levelIdx)));
+		}
+		m_PageFile.flush();
+		if (!m_PageFile)
+		{
+			m_PageFile.clear();
+			entry.pageOffsets.clear();
+		}
+	}
+
+	for (int levelIdx{ pChain->GetFirstResidentLevel() }; levelIdx < numLevels; ++levelIdx)
+	{
+		m_ResidentSize += pChain->GetLevelSize(levelIdx);
+	}
+	m_Entries.emplace_back(std::move(entry));
+
+	Entry& registered{ m_Entries.back() };
+	while (!registered.pageOffsets.empty() && pChain->GetFirstResidentLevel() < numLevels - 1
+		&& pChain->GetLevelSize(pChain->GetFirstResidentLevel()) > MaxRegisteredLevelSize)
+	{
+		EvictLevel(registered);
+	}
+	EvictOverBudget(m_Frame + 1);
+}
+
+void TextureResidency::Update()
+{
+	++m_Frame;
+
+	//Trilinear filtering and lower lods need everything below the finest requested level too
+	for (Entry& entry : m_Entries)
+	{
+		const int numLevels{ entry.pChain->GetNumMipLevels() };
+		const int requested{ entry.pChain->m_RequestedLevel.exchange(INT_MAX, std::memory_order_relaxed) };
+		entry.wantedLevel = std::clamp(requested, 0, numLevels);
+		for (int levelIdx{ entry.wantedLevel }; levelIdx < numLevels; ++levelIdx)
+		{
+			entry.lastUsedFrames[levelIdx] = m_Frame;
+		}
+	}
+
+	//Coarse to fine, so a chain that runs out of budget still gets as close as it can
+	for (Entry& entry : m_Entries)
+	{
+		while (entry.pChain->GetFirstResidentLevel() > entry.wantedLevel)
+		{
+			const size_t levelSize{ entry.pChain->GetLevelSize(entry.pChain->GetFirstResidentLevel() - 1) };
+			//Only levels this frame didn't touch make room, otherwise two chains would keep pushing each other out
+			while (m_ResidentSize + levelSize > m_Budget)
+			{
+				Entry* pVictim{ FindEvictionCandidate(m_Frame) };
+				if (!pVictim)
+					break;
+				EvictLevel(*pVictim);
+			}
+			if (m_ResidentSize + levelSize > m_Budget || !PageInLevel(entry))
+				break;
+		}
+	}
+
+	//The budget can have been lowered since the last call
+	EvictOverBudget(m_Frame + 1);
+}
+
+TextureResidency::Entry* TextureResidency::FindEvictionCandidate(uint64_t usedBefore)
+{
+	Entry* pCandidate{ nullptr };
+	uint64_t oldestFrame{ usedBefore };
+	for (Entry& entry : m_Entries)
+	{
+		const int levelIdx{ entry.pChain->GetFirstResidentLevel() };
+		if (entry.pageOffsets.empty() || levelIdx >= entry.pChain->GetNumMipLevels() - 1)
+			continue;
+
+		if (entry.lastUsedFrames[levelIdx] < oldestFrame)
+		{
+			oldestFrame = entry.lastUsedFrames[levelIdx];
+			pCandidate = &entry;
+		}
+	}
+	return pCandidate;
+}
+
+void TextureResidency::EvictOverBudget(uint64_t usedBefore)
+{
+	while (m_ResidentSize > m_Budget)
+	{
+		Entry* pVictim{ FindEvictionCandidate(usedBefore) };
+		if (!pVictim)
+			return;
+		EvictLevel(*pVictim);
+	}
+}
+
+void TextureResidency::EvictLevel(Entry& entry)
+{
+	StreamedMipChain* pChain{ entry.pChain };
+	const int levelIdx{ pChain->m_FirstResidentLevel };
+	pChain->ReleaseLevel(levelIdx);
+	m_ResidentSize -= pChain->GetLevelSize(levelIdx);
+	++pChain->m_FirstResidentLevel;
+}
+
+bool TextureResidency::PageInLevel(Entry& entry)
+{
+	StreamedMipChain* pChain{ entry.pChain };
+	const int levelIdx{ pChain->m_FirstResidentLevel - 1 };
+	const size_t levelSize{ pChain->GetLevelSize(levelIdx) };
+
+	void* pData{ pChain->AllocateLevel(levelIdx) };
+	m_PageFile.seekg(entry.pageOffsets[levelIdx]);
+	m_PageFile.read(static_cast<char*>(pData), std::streamsize(levelSize));
+	if (!m_PageFile)
+	{
+		m_PageFile.clear();
+		pChain->ReleaseLevel(levelIdx);
+		return false;
+	}
+
+	m_ResidentSize += levelSize;
+	--pChain->m_FirstResidentLevel;
+	return true;
+}
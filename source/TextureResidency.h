@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//Mip chain whose finer levels a TextureResidency can page out, Texture and MaterialTextureSet are one
+//Sampling clamps to the finest level still in memory and reports the level it really wanted, the manager acts on that between frames
+class StreamedMipChain
+{
+public:
+	virtual ~StreamedMipChain() = default;
+
+	virtual int GetNumMipLevels() const = 0;
+	//Levels above this one have no texel data right now
+	int GetFirstResidentLevel() const { return m_FirstResidentLevel; }
+
+protected:
+	//For sampling, from any thread: records lod as wanted and returns the lod to use, which is never finer than the resident levels
+	float RequestLod(float lod) const
+	{
+		const int levelIdx{ int(lod) };
+		//Relaxed min, after the first few samples of a frame it is just a load
+		int requested{ m_RequestedLevel.load(std::memory_order_relaxed) };
+		while (levelIdx < requested && !m_RequestedLevel.compare_exchange_weak(requested, levelIdx, std::memory_order_relaxed)) {}
+		return std::max(lod, float(m_FirstResidentLevel));
+	}
+
+	//Bytes of texel (or block) data of a level, also while it's paged out
+	virtual size_t GetLevelSize(int levelIdx) const = 0;
+	virtual const void* GetLevelData(int levelIdx) const = 0;
+	//Frees the texel data of a level, or allocates it again for the manager to read back into
+	virtual void ReleaseLevel(int levelIdx) = 0;
+	virtual void* AllocateLevel(int levelIdx) = 0;
+
+private:
+	friend class TextureResidency;
+	//Only moved by the manager, between frames
+	int m_FirstResidentLevel{};
+	//Finest level sampled since the manager last looked, INT_MAX when nothing was
+	mutable std::atomic<int> m_RequestedLevel{ INT_MAX };
+};
+
+//Keeps the CPU mip levels of all registered chains within a byte budget
+//Every level is written to a page file once; the finest levels are dropped least recently used first and read back when sampling asks for them again
+//The coarsest level of a chain always stays, so there's something to sample
+class TextureResidency final
+{
+public:
+	//Registering keeps the levels up to this size in memory, the finer ones are only read back once sampling asks for them
+	static constexpr size_t MaxRegisteredLevelSize{ 64 * 1024 };
+
+	//The page file is created at pageFilePath and removed again by the destructor, so it needs to be unique to the process
+	TextureResidency(size_t budgetInBytes, const std::string& pageFilePath);
+	~TextureResidency();
+
+	TextureResidency(const TextureResidency&) = delete;
+	TextureResidency(TextureResidency&&) noexcept = delete;
+	TextureResidency& operator=(const TextureResidency&) = delete;
+	TextureResidency& operator=(TextureResidency&&) noexcept = delete;
+
+	//The chain has to be complete and resident, the manager doesn't own it
+	//Every level above MaxRegisteredLevelSize is paged out right away, so a chain only costs its coarse levels until it is sampled
+	void Register(StreamedMipChain* pChain);
+	//Between frames, with no sampling going on: reads in the levels sampled since the last call, evicting what that frame didn't use to make room
+	//A level that doesn't fit stays out, sampling then keeps using the next coarser one
+	void Update();
+
+	void SetBudget(size_t budgetInBytes) { m_Budget = budgetInBytes; }
+	size_t GetBudget() const { return m_Budget; }
+	//Bytes of texel data in memory over all chains
+	size_t GetResidentSize() const { return m_ResidentSize; }
+
+private:
+	struct Entry
+	{
+		StreamedMipChain* pChain{ nullptr };
+		//Where each level starts in the page file, empty when it couldn't be written so the chain is never evicted
+		std::vector<std::streamoff> pageOffsets{};
+		//Last Update that saw the level sampled
+		std::vector<uint64_t> lastUsedFrames{};
+		//Finest level the current Update reads in, kept here so a frame doesn't allocate
+		int wantedLevel{};
+	};
+	std::vector<Entry> m_Entries{};
+	std::fstream m_PageFile{};
+	std::string m_PageFilePath{};
+
+	size_t m_Budget{};
+	size_t m_ResidentSize{};
+	uint64_t m_Frame{};
+
+	//Finest resident level of every chain that is allowed to go, least recently used one; nullptr when none was last used before usedBefore
+	Entry* FindEvictionCandidate(uint64_t usedBefore);
+	void EvictOverBudget(uint64_t usedBefore);
+	void EvictLevel(Entry& entry);
+	bool PageInLevel(Entry& entry);
+};
@@ -0,0 +1,124 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+namespace dae
+{
+	ThreadPool::ThreadPool(uint32_t numThreads)
+	{
+		//hardware_concurrency is allowed to return 0 when it can't tell
+		const uint32_t numWorkers{ numThreads > 1 ? numThreads - 1 : 0 };
+
+		m_Workers.reserve(numWorkers);
+		for (uint32_t i{}; i < numWorkers; ++i)
+		{
+			m_Workers.emplace_back([this]() { WorkerLoop(); });
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_TaskAvailable.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job)
+	{
+		Batch batch{};
+		Start(batch, count, job);
+		Wait(batch);
+	}
+
+	void ThreadPool::Start(Batch& batch, uint32_t count, const std::function<void(uint32_t)>& job)
+	{
+		batch.pJob = &job;
+		batch.count = count;
+		batch.nextIndex = 0;
+		batch.numHelpersRunning = 0;
+
+		//The caller takes part as well, so one index less is left for the workers
+		const uint32_t numHelpers{ count > 0 ? std::min(count - 1, uint32_t(m_Workers.size())) : 0 };
+		if (numHelpers > 0)
+		{
+			{
+				std::lock_guard<std::mutex> lock{ m_Mutex };
+				m_pBatch = &batch;
+				m_NumHelpersWanted = numHelpers;
+			}
+			m_TaskAvailable.notify_all();
+		}
+	}
+
+	bool ThreadPool::RunNext(Batch& batch)
+	{
+		const uint32_t i{ batch.nextIndex++ };
+		if (i >= batch.count)
+			return false;
+
+		(*batch.pJob)(i);
+		return true;
+	}
+
+	void ThreadPool::Wait(Batch& batch)
+	{
+		RunJobs(batch);
+
+		//Every index is taken by now, so workers that haven't joined yet aren't needed anymore
+		std::unique_lock<std::mutex> lock{ m_Mutex };
+		if (m_pBatch == &batch)
+		{
+			m_pBatch = nullptr;
+			m_NumHelpersWanted = 0;
+		}
+		m_HelpersDone.wait(lock, [&batch]() { return batch.numHelpersRunning == 0; });
+	}
+
+	void ThreadPool::RunJobs(Batch& batch)
+	{
+		//Every thread keeps grabbing the next index until none are left, this balances uneven jobs (e.g. empty tiles)
+		while (RunNext(batch))
+		{
+		}
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task{};
+			{
+				std::unique_lock<std::mutex> lock{ m_Mutex };
+				m_TaskAvailable.wait(lock, [this]() { return m_IsStopping || m_NumHelpersWanted > 0 || !m_Tasks.empty(); });
+
+				if (m_NumHelpersWanted > 0)
+				{
+					--m_NumHelpersWanted;
+					Batch* pBatch{ m_pBatch };
+					++pBatch->numHelpersRunning;
+					lock.unlock();
+
+					RunJobs(*pBatch);
+
+					lock.lock();
+					if (--pBatch->numHelpersRunning == 0)
+						m_HelpersDone.notify_all();
+					continue;
+				}
+
+				if (m_IsStopping && m_Tasks.empty())
+					return;
+
+				task = std::move(m_Tasks.front());
+				m_Tasks.pop();
+			}
+			task();
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+namespace dae
+{
+	//Fixed set of worker threads that is created once and reused every frame
+	class ThreadPool final
+	{
+	public:
+		//The calling thread also works during ParallelFor, so one thread less is spawned than requested
+		explicit ThreadPool(uint32_t numThreads = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		//Index range that is being worked on, lives on the stack of whoever started it until Wait returns
+		struct Batch
+		{
+			const std::function<void(uint32_t)>* pJob{};
+			uint32_t count{};
+			std::atomic<uint32_t> nextIndex{};
+			uint32_t numHelpersRunning{};
+		};
+
+		//Calls job(i) for every i in [0, count) spread over all threads, returns once every call has finished
+		//Doesn't allocate, so it can run every frame; only one batch can be active at a time
+		void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+
+		//Same as ParallelFor, split up so the caller can do other work while the workers go through the batch
+		//job has to stay alive until Wait returns, indices are handed out in increasing order
+		void Start(Batch& batch, uint32_t count, const std::function<void(uint32_t)>& job);
+		//Runs the next index that nobody picked up yet on the calling thread, false once every index is taken
+		static bool RunNext(Batch& batch);
+		//Helps out until every index is taken, then waits for the workers that are still busy
+		void Wait(Batch& batch);
+
+		//Runs job on the next free worker and hands its result back through the future, meant for one-off work like loading
+		//Batches go first, so a long job never delays a frame; without workers the job runs right away on the calling thread
+		template<typename Job>
+		std::future<std::invoke_result_t<Job>> Enqueue(Job job)
+		{
+			//std::function has to be copyable, the task itself isn't
+			auto pTask{ std::make_shared<std::packaged_task<std::invoke_result_t<Job>()>>(std::move(job)) };
+			auto result{ pTask->get_future() };
+			if (m_Workers.empty())
+			{
+				(*pTask)();
+				return result;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock{ m_Mutex };
+				m_Tasks.emplace([pTask]() { (*pTask)(); });
+			}
+			m_TaskAvailable.notify_one();
+			return result;
+		}
+
+		uint32_t GetNumThreads() const { return uint32_t(m_Workers.size()) + 1; }
+
+	private:
+		std::vector<std::thread> m_Workers{};
+		std::queue<std::function<void()>> m_Tasks{};
+
+		Batch* m_pBatch{};
+		uint32_t m_NumHelpersWanted{};
+		std::condition_variable m_HelpersDone{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_TaskAvailable{};
+		bool m_IsStopping{ false };
+
+		void WorkerLoop();
+		static void RunJobs(Batch& batch);
+	};
+}
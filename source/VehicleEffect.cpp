@@ -1,6 +1,7 @@
 ﻿#include "pch.h"
 #include "VehicleEffect.h"
 #include "Texture.h"
+#include "Light.h"
 
 
 VehicleEffect::VehicleEffect(ID3D11Device* pDevice, const std::wstring& assetFile):
@@ -37,6 +38,26 @@ VehicleEffect::VehicleEffect(ID3D11Device* pDevice, const std::wstring& assetFil
 	if (!m_pDiffuseMapVariable->IsValid())
 		std::wcout << L"m_pDiffuseMapVariable is not valid\n";
 
+	m_pNumLightsVariable = m_pEffect->GetVariableByName("gNumLights")->AsScalar();
+	if (!m_pNumLightsVariable->IsValid())
+		std::wcout << L"m_pNumLightsVariable is not valid\n";
+
+	m_pLightPositionsVariable = m_pEffect->GetVariableByName("gLightPositions")->AsVector();
+	if (!m_pLightPositionsVariable->IsValid())
+		std::wcout << L"m_pLightPositionsVariable is not valid\n";
+
+	m_pLightDirectionsVariable = m_pEffect->GetVariableByName("gLightDirections")->AsVector();
+	if (!m_pLightDirectionsVariable->IsValid())
+		std::wcout << L"m_pLightDirectionsVariable is not valid\n";
+
+	m_pLightColorsVariable = m_pEffect->GetVariableByName("gLightColors")->AsVector();
+	if (!m_pLightColorsVariable->IsValid())
+		std::wcout << L"m_pLightColorsVariable is not valid\n";
+
+	m_pLightConesVariable = m_pEffect->GetVariableByName("gLightCones")->AsVector();
+	if (!m_pLightConesVariable->IsValid())
+		std::wcout << L"m_pLightConesVariable is not valid\n";
+
 }
 
 VehicleEffect::~VehicleEffect()
@@ -45,6 +66,11 @@ VehicleEffect::~VehicleEffect()
 	m_pNormalMapVariable->Release();
 	m_pSpecularMapVariable->Release();
 	m_pGlossinessMapVariable->Release();
+	m_pNumLightsVariable->Release();
+	m_pLightPositionsVariable->Release();
+	m_pLightDirectionsVariable->Release();
+	m_pLightColorsVariable->Release();
+	m_pLightConesVariable->Release();
 
 }
 
@@ -70,3 +96,29 @@ void VehicleEffect::SetGlossinessMap(const Texture* pGlossinesstexture)
 	if (m_pGlossinessMapVariable)
 		m_pGlossinessMapVariable->SetResource(pGlossinesstexture->GetSRV());
 }
+
+void VehicleEffect::SetLights(const std::vector<dae::Light>& lights)
+{
+	//Packed like the light arrays in VehicleShader.fx: position and type, direction and range, color and intensity, cone cosines
+	const int numLights{ std::min(int(lights.size()), MaxLights) };
+	dae::Vector4 positions[MaxLights]{};
+	dae::Vector4 directions[MaxLights]{};
+	dae::Vector4 colors[MaxLights]{};
+	dae::Vector4 cones[MaxLights]{};
+	for (int lightIdx{}; lightIdx < numLights; ++lightIdx)
+	{
+		const dae::Light& light{ lights[lightIdx] };
+		positions[lightIdx] = { light.position, float(light.type) };
+		directions[lightIdx] = { light.direction, light.range };
+		colors[lightIdx] = { light.color.r, light.color.g, light.color.b, light.intensity };
+		cones[lightIdx] = { light.innerConeCos, light.outerConeCos, 0.f, 0.f };
+	}
+
+	m_pNumLightsVariable->SetInt(numLights);
+	if (numLights == 0)
+		return;
+	m_pLightPositionsVariable->SetFloatVectorArray(&positions[0].x, 0, numLights);
+	m_pLightDirectionsVariable->SetFloatVectorArray(&directions[0].x, 0, numLights);
+	m_pLightColorsVariable->SetFloatVectorArray(&colors[0].x, 0, numLights);
+	m_pLightConesVariable->SetFloatVectorArray(&cones[0].x, 0, numLights);
+}
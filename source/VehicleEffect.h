@@ -1,6 +1,11 @@
 ﻿#pragma once
 #include "Effect.h"
+#include <vector>
 class Texture;
+namespace dae
+{
+	struct Light;
+}
 class VehicleEffect final : public Effect
 {
 public:
@@ -12,12 +17,21 @@ public:
 		void SetNormalMap(const Texture* pNormaltexture);
 		void SetSpecularMap(const Texture* pSpeculartexture);
 		void SetGlossinessMap(const Texture* pGlossinesstexture);
+		//Only the first MaxLights make it into the shader, it has no light culling and loops over all of them per pixel
+		void SetLights(const std::vector<dae::Light>& lights);
+
+		static constexpr int MaxLights{ 16 };
 
 private:
 	ID3DX11EffectShaderResourceVariable* m_pDiffuseMapVariable{};
 	ID3DX11EffectShaderResourceVariable* m_pNormalMapVariable{};
 	ID3DX11EffectShaderResourceVariable* m_pSpecularMapVariable{};
 	ID3DX11EffectShaderResourceVariable* m_pGlossinessMapVariable{};
+	ID3DX11EffectScalarVariable* m_pNumLightsVariable{};
+	ID3DX11EffectVectorVariable* m_pLightPositionsVariable{};
+	ID3DX11EffectVectorVariable* m_pLightDirectionsVariable{};
+	ID3DX11EffectVectorVariable* m_pLightColorsVariable{};
+	ID3DX11EffectVectorVariable* m_pLightConesVariable{};
 	
 	
 };
@@ -6,6 +6,7 @@
 
 #undef main
 #include "Renderer.h"
+#include "Benchmarks.h"
 #include <Windows.h> // For colored text on Windows
 
 
@@ -57,13 +58,13 @@ void DisplayControlsOverview()
 	SetConsoleTextColor(instructionColor);
 	std::cout << "F4";
 	SetConsoleTextColor(controlColor);
-	std::cout << ": Cycle through SampleStates (point, linear, anisotropic) for rendering (Anisotropic is Hardware mode only).\n";
+	std::cout << ": Cycle through SampleStates (point, linear, anisotropic) for rendering.\n";
 
 	std::cout << "- Press ";
 	SetConsoleTextColor(instructionColor);
 	std::cout << "F5";
 	SetConsoleTextColor(controlColor);
-	std::cout << ": Cycle through Shading modes (Observed Area, Diffuse, Specular, Combined) for rendering (Software mode only).\n";
+	std::cout << ": Cycle through Shading modes (Observed Area, Diffuse, Specular, Combined, Physically Based) for rendering (Software mode only).\n";
 
 	std::cout << "- Press ";
 	SetConsoleTextColor(instructionColor);
@@ -101,6 +102,30 @@ void DisplayControlsOverview()
 	SetConsoleTextColor(controlColor);
 	std::cout << ": Toggle FPS Printing.\n";
 
+	std::cout << "- Press ";
+	SetConsoleTextColor(instructionColor);
+	std::cout << "T";
+	SetConsoleTextColor(controlColor);
+	std::cout << ": Toggle Tiled multithreaded rendering (Software mode only).\n";
+
+	std::cout << "- Press ";
+	SetConsoleTextColor(instructionColor);
+	std::cout << "X";
+	SetConsoleTextColor(controlColor);
+	std::cout << ": Cycle through SIMD rasterizer paths supported by this CPU (scalar, SSE2, AVX2) (Software mode only).\n";
+
+	std::cout << "- Press ";
+	SetConsoleTextColor(instructionColor);
+	std::cout << "V";
+	SetConsoleTextColor(controlColor);
+	std::cout << ": Toggle Deferred shading through a visibility buffer (Software mode only).\n";
+
+	std::cout << "- Press ";
+	SetConsoleTextColor(instructionColor);
+	std::cout << "H";
+	SetConsoleTextColor(controlColor);
+	std::cout << ": Toggle Shadows of the first directional light (Software mode only).\n";
+
 	SetConsoleTextColor(instructionColor);
 	std::cout << "\nInstructions:\n";
 	SetConsoleTextColor(controlColor);
@@ -108,7 +133,7 @@ void DisplayControlsOverview()
 	SetConsoleTextColor(controlColor);
 	std::cout << "- In Hardware mode, F1, F2, F3, F4, F9, F10 and F11 controls are available.\n";
 	SetConsoleTextColor(controlColor);
-	std::cout << "- In Software mode, F1, F2, F5, F6, F7, F8, F9, F10, and F11 controls are available.\n";
+	std::cout << "- In Software mode, F1, F2, F4, F5, F6, F7, F8, F9, F10, F11, T, X, V and H controls are available.\n";
 	SetConsoleTextColor(instructionColor);
 	std::cout << "- The console will display messages indicating the current state or mode after each control is triggered.\n";
 
@@ -118,10 +143,21 @@ void DisplayControlsOverview()
 
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
-	
+	//--benchmark only runs the CPU benchmarks, no window is created
+	//--texture-budget <MB> limits the CPU texture memory, finer mip levels are then streamed from disk
+	//--lights <count> adds that many point lights around the vehicle and prints how many of them every screen tile evaluates
+	int textureBudgetMB{ -1 };
+	int numExtraLights{};
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		if (std::string{ args[i] } == "--benchmark")
+			return Benchmarks::Run();
+		if (std::string{ args[i] } == "--texture-budget" && i + 1 < argc)
+			textureBudgetMB = std::max(std::atoi(args[++i]), 0);
+		if (std::string{ args[i] } == "--lights" && i + 1 < argc)
+			numExtraLights = std::max(std::atoi(args[++i]), 0);
+	}
+
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
 
@@ -140,6 +176,28 @@ int main(int argc, char* args[])
 	//Initialize "framework"
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
+	if (!pRenderer->IsInitialized())
+	{
+		delete pRenderer;
+		delete pTimer;
+		ShutDown(pWindow);
+		return 1;
+	}
+	if (textureBudgetMB >= 0)
+	{
+		pRenderer->SetTextureBudget(size_t(textureBudgetMB) * 1024 * 1024);
+		std::cout << "CPU texture budget: " << textureBudgetMB << " MB\n";
+	}
+	const ColorRGB lightColors[]{ { 1.f, .4f, .3f }, { .4f, 1.f, .4f }, { .4f, .6f, 1.f }, { 1.f, .9f, .5f } };
+	const Vector3 vehiclePosition{ pRenderer->GetVehicleMesh()->GetWorldMatrix().GetTranslation() };
+	for (int lightIdx{}; lightIdx < numExtraLights; ++lightIdx)
+	{
+		//Golden angle steps around the vehicle, so any number of lights spreads out evenly
+		const float angle{ lightIdx * 2.39996323f };
+		const float height{ -6.f + 2.f * float(lightIdx % 7) };
+		const Vector3 offset{ 24.f * cosf(angle), height, 24.f * sinf(angle) };
+		pRenderer->AddLight(Light::CreatePoint(vehiclePosition + offset, 16.f, 2.f, lightColors[lightIdx % 4]));
+	}
 
 	//Start loop
 	pTimer->Start();
@@ -150,7 +208,7 @@ int main(int argc, char* args[])
 	const std::string SoftwareRenderingMode {"Software"};
 	bool printFPS{ true };
 
-	std::cout << "Dual Rasterizer - Semih Teke 2DAE08\nExtra Feature: Linear Filtering in Software mode (F4)\n";
+	std::cout << "Dual Rasterizer - Semih Teke 2DAE08\nExtra Feature: Linear and Anisotropic Filtering in Software mode (F4)\n";
 	DisplayControlsOverview();
 
 	while (isLooping)
@@ -223,9 +281,8 @@ int main(int argc, char* args[])
 				//Cycle SampleStates (point, linear, anisotropic)
 				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
 				{
-					bool usingDX{ pRenderer->GetRenderingMode() == "DirectX 11" ? true : false };
-					pRenderer->GetVehicleMesh()->UpdateFilterMode(usingDX);
-					pRenderer->GetFireMesh()->UpdateFilterMode(usingDX);
+					pRenderer->GetVehicleMesh()->UpdateFilterMode();
+					pRenderer->GetFireMesh()->UpdateFilterMode();
 
 					std::cout << "\n\nCurrent Filter Mode: " << pRenderer->GetVehicleMesh()->GetFilterModeName() << "\n\n";
 				}
@@ -254,6 +311,9 @@ int main(int argc, char* args[])
 					case Renderer::LightingMode::Combined:
 						std::cout << "Combined\n\n";
 						break;
+					case Renderer::LightingMode::PhysicallyBased:
+						std::cout << "Physically Based\n\n";
+						break;
 					}
 				}
 				//Toggle NormalMap
@@ -274,6 +334,30 @@ int main(int argc, char* args[])
 					pRenderer->ToggleBBVis();
 					std::cout << "\n\nUse BoundingBox Visualization: " << std::boolalpha << pRenderer->GetUseBBVis() << "\n\n";
 				}
+				//Toggle Tiled rendering
+				if (e.key.keysym.scancode == SDL_SCANCODE_T)
+				{
+					pRenderer->ToggleTiledRendering();
+					std::cout << "\n\nUse Tiled Rendering: " << std::boolalpha << pRenderer->GetUseTiledRendering() << "\n\n";
+				}
+				//Cycle SIMD rasterizer paths
+				if (e.key.keysym.scancode == SDL_SCANCODE_X)
+				{
+					pRenderer->CycleSimdLevel();
+					std::cout << "\n\nSIMD rasterizer path: " << Simd::GetLevelName(pRenderer->GetSimdLevel()) << "\n\n";
+				}
+				//Toggle Deferred shading
+				if (e.key.keysym.scancode == SDL_SCANCODE_V)
+				{
+					pRenderer->ToggleDeferredShading();
+					std::cout << "\n\nUse Deferred Shading: " << std::boolalpha << pRenderer->GetUseDeferredShading() << "\n\n";
+				}
+				//Toggle Shadows
+				if (e.key.keysym.scancode == SDL_SCANCODE_H)
+				{
+					pRenderer->ToggleShadows();
+					std::cout << "\n\nUse Shadows: " << std::boolalpha << pRenderer->GetUseShadows() << "\n\n";
+				}
 				break;
 			default:;
 			}
@@ -292,6 +376,20 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			if (pRenderer->GetRenderingMode() == SoftwareRenderingMode)
+			{
+				std::cout << "Software frame arena: " << pRenderer->GetFrameArenaHeapAllocations() << " heap allocations, "
+					<< pRenderer->GetFrameArenaCapacity() / 1024 << " KB" << std::endl;
+			}
+			if (numExtraLights > 0 && pRenderer->GetRenderingMode() == SoftwareRenderingMode)
+			{
+				const std::vector<uint32_t> tileLightCounts{ pRenderer->GetTileLightCounts() };
+				uint32_t totalLights{};
+				for (const uint32_t count : tileLightCounts)
+					totalLights += count;
+				std::cout << "Lights per tile: max " << *std::max_element(tileLightCounts.begin(), tileLightCounts.end())
+					<< ", average " << float(totalLights) / tileLightCounts.size() << " of " << pRenderer->GetLights().size() << std::endl;
+			}
 		}
 	}
 	pTimer->Stop();